@@ -5,9 +5,39 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <new>
+#include <limits>
+#ifdef _WIN32
+#include <malloc.h>
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PLOTTER_SSE2 1
+#endif
 class Point {
 public:
     double x, y;
+    Point() : x(0), y(0) {}
     Point(double x, double y) : x(x), y(y) {}
 };
 
@@ -17,277 +47,4644 @@ public:
     Range(double min, double max) : min(min), max(max) {}
 };
 
-class Function {
+// Optional 2 MB pages for big sample buffers: a multi-gigabyte reduction
+// otherwise spends much of its time in TLB misses. On Linux the memory is
+// mapped 2 MB-aligned and marked for transparent huge pages; on Windows
+// large pages need the "Lock pages in memory" privilege. When the system
+// refuses, buffers silently fall back to the regular allocator.
+//
+// The mapping is not touched here, so each page lands on the NUMA node of
+// the thread that first writes it (the default first-touch policy on
+// Linux and Windows). Parallel sampling fills whole pages per task to
+// take advantage of that.
+class LargePages {
 public:
-    virtual double evaluate(double x) = 0;
-    virtual std::string getFormula() = 0;
+    static const size_t kPageBytes = 2u << 20;
+    static const size_t kMinimumBytes = 2 * kPageBytes; // smaller buffers waste too much
+
+private:
+    static std::atomic<bool>& enabledFlag() {
+        static std::atomic<bool> enabled(false);
+        return enabled;
+    }
+
+    static std::atomic<size_t>& bytesInUse() {
+        static std::atomic<size_t> bytes(0);
+        return bytes;
+    }
+
+#ifdef _WIN32
+    // MEM_LARGE_PAGES fails unless SeLockMemoryPrivilege is enabled in the
+    // process token, even when the account holds it. Done once.
+    static bool enableLockMemoryPrivilege() {
+        HANDLE token;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+            return false;
+        }
+        TOKEN_PRIVILEGES privileges = {};
+        privileges.PrivilegeCount = 1;
+        privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        bool enabled = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid)
+            && AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr)
+            && GetLastError() == ERROR_SUCCESS; // ERROR_NOT_ALL_ASSIGNED: the account lacks it
+        CloseHandle(token);
+        return enabled;
+    }
+#endif
+
+public:
+    static void setEnabled(bool enabled) {
+        enabledFlag() = enabled;
+    }
+
+    static bool isEnabled() {
+        return enabledFlag();
+    }
+
+    static size_t getBytesInUse() {
+        return bytesInUse();
+    }
+
+    static size_t roundUp(size_t bytes) {
+        return (bytes + kPageBytes - 1) / kPageBytes * kPageBytes;
+    }
+
+    // nullptr when large pages are off, bytes is small or the system
+    // refuses; the caller then uses the regular allocator.
+    static void* allocate(size_t bytes) {
+        if (!isEnabled() || bytes < kMinimumBytes) {
+            return nullptr;
+        }
+        size_t size = roundUp(bytes);
+#ifdef _WIN32
+        static const bool privileged = enableLockMemoryPrivilege();
+        if (!privileged || GetLargePageMinimum() == 0 || kPageBytes % GetLargePageMinimum() != 0) {
+            return nullptr;
+        }
+        void* memory = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (!memory) {
+            return nullptr;
+        }
+#elif defined(__linux__)
+        // Over-map by one page and trim, so the block starts on a 2 MB boundary
+        char* raw = static_cast<char*>(mmap(nullptr, size + kPageBytes, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (raw == MAP_FAILED) {
+            return nullptr;
+        }
+        char* memory = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(raw) + kPageBytes - 1) & ~(kPageBytes - 1));
+        if (memory > raw) {
+            munmap(raw, memory - raw);
+        }
+        if (raw + kPageBytes > memory) {
+            munmap(memory + size, raw + kPageBytes - memory);
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(memory, size, MADV_HUGEPAGE);
+#endif
+#else
+        return nullptr;
+#endif
+        bytesInUse() += size;
+        return memory;
+    }
+
+    static void release(void* memory, size_t bytes) {
+        size_t size = roundUp(bytes);
+        bytesInUse() -= size;
+#ifdef _WIN32
+        VirtualFree(memory, 0, MEM_RELEASE);
+#elif defined(__linux__)
+        munmap(memory, size);
+#else
+        (void)memory;
+#endif
+    }
 };
 
-class PolynomialFunction : public Function {
+const size_t LargePages::kPageBytes;
+const size_t LargePages::kMinimumBytes;
+
+// Growable array of a trivially copyable type whose storage starts on a
+// 64-byte boundary, so vector loads never straddle cache lines. Unlike
+// std::vector, resize() leaves new elements uninitialized.
+template <typename T>
+class AlignedArray {
 private:
-    std::vector<double> coefficients;
+    static const size_t kAlignment = 64;
+    T* items;
+    size_t count;
+    size_t capacity;
+    bool largePages; // items came from LargePages
+
+    static T* allocate(size_t n, bool& large) {
+        large = false;
+        if (n == 0) {
+            return nullptr;
+        }
+        if (void* memory = LargePages::allocate(n * sizeof(T))) {
+            large = true;
+            return static_cast<T*>(memory);
+        }
+#ifdef _WIN32
+        void* memory = _aligned_malloc(n * sizeof(T), kAlignment);
+#else
+        void* memory = nullptr;
+        if (posix_memalign(&memory, kAlignment, n * sizeof(T)) != 0) {
+            memory = nullptr;
+        }
+#endif
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(memory);
+    }
+
+    static void release(T* memory, size_t n, bool large) {
+        if (large) {
+            LargePages::release(memory, n * sizeof(T));
+            return;
+        }
+#ifdef _WIN32
+        _aligned_free(memory);
+#else
+        free(memory);
+#endif
+    }
+
 public:
-    PolynomialFunction(std::vector<double> coeffs) : coefficients(coeffs) {}
+    AlignedArray() : items(nullptr), count(0), capacity(0), largePages(false) {}
 
-    double evaluate(double x) override {
-        double result = 0;
-        for (int i = 0; i < coefficients.size(); ++i) {
-            result += coefficients[i] * std::pow(x, i);
+    AlignedArray(const AlignedArray& other)
+        : items(nullptr), count(other.count), capacity(other.count), largePages(false) {
+        items = allocate(count, largePages);
+        if (count) {
+            std::memcpy(items, other.items, count * sizeof(T));
+        }
+    }
+
+    AlignedArray(AlignedArray&& other) noexcept
+        : items(other.items), count(other.count), capacity(other.capacity), largePages(other.largePages) {
+        other.items = nullptr;
+        other.count = other.capacity = 0;
+        other.largePages = false;
+    }
+
+    AlignedArray& operator=(AlignedArray other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~AlignedArray() {
+        release(items, capacity, largePages);
+    }
+
+    void swap(AlignedArray& other) noexcept {
+        std::swap(items, other.items);
+        std::swap(count, other.count);
+        std::swap(capacity, other.capacity);
+        std::swap(largePages, other.largePages);
+    }
+
+    void reserve(size_t n) {
+        if (n <= capacity) {
+            return;
+        }
+        bool large;
+        T* grown = allocate(n, large);
+        if (count) {
+            std::memcpy(grown, items, count * sizeof(T));
+        }
+        release(items, capacity, largePages);
+        items = grown;
+        capacity = n;
+        largePages = large;
+    }
+
+    void resize(size_t n) {
+        reserve(n);
+        count = n;
+    }
+
+    void push_back(T value) {
+        if (count == capacity) {
+            reserve(capacity ? capacity * 2 : 16);
+        }
+        items[count++] = value;
+    }
+
+    void clear() { count = 0; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool usesLargePages() const { return largePages; }
+    T* data() { return items; }
+    const T* data() const { return items; }
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+};
+
+// A contiguous run of samples handed to consumers (renderer, serializer).
+// x is either explicit (xs) or implicit: x0 + (first + i) * dx.
+struct SeriesChunk {
+    size_t first, count;
+    const double* xs; // nullptr when x is implicit
+    double x0, dx;
+    const double* ys;
+
+    double x(size_t i) const { return xs ? xs[i] : x0 + (first + i) * dx; }
+};
+
+// Point series stored as a structure of arrays: all x values in one aligned
+// array, all y values in another. A uniformly sampled series (x = x0 + i*dx,
+// as produced by Graph::generatePoints) keeps only x0 and dx and derives x on
+// the fly, halving its memory; loaded, irregular data stores x explicitly.
+// operator[] and iteration yield Point by value, so code written against
+// std::vector<Point> keeps working.
+class SampleSeries {
+private:
+    AlignedArray<double> xs, ys;
+    bool uniform;
+    double x0, dx;
+
+public:
+    class const_iterator {
+    private:
+        const SampleSeries* series;
+        size_t index;
+    public:
+        const_iterator(const SampleSeries* series, size_t index) : series(series), index(index) {}
+        Point operator*() const { return (*series)[index]; }
+        const_iterator& operator++() { ++index; return *this; }
+        bool operator!=(const const_iterator& other) const { return index != other.index; }
+        bool operator==(const const_iterator& other) const { return index == other.index; }
+    };
+
+    SampleSeries() : uniform(false), x0(0), dx(0) {}
+
+    size_t size() const { return ys.size(); }
+    bool empty() const { return ys.empty(); }
+    bool isUniform() const { return uniform; }
+    double getX0() const { return x0; }
+    double getDx() const { return dx; }
+
+    // Explicit-x series of n points; new elements are uninitialized.
+    void resize(size_t n) {
+        if (uniform) {
+            clear();
+        }
+        xs.resize(n);
+        ys.resize(n);
+    }
+
+    // Uniform series of n points starting at start with spacing step;
+    // y values are uninitialized.
+    void assignUniform(double start, double step, size_t n) {
+        xs = AlignedArray<double>();
+        ys.resize(n);
+        uniform = true;
+        x0 = start;
+        dx = step;
+    }
+
+    void clear() {
+        xs.clear();
+        ys.clear();
+        uniform = false;
+    }
+
+    void push_back(double x, double y) {
+        if (uniform) {
+            // Appending arbitrary x breaks the spacing: store x explicitly from now on
+            xs.resize(ys.size());
+            expandX(0, ys.size(), xs.data());
+            uniform = false;
+        }
+        xs.push_back(x);
+        ys.push_back(y);
+    }
+
+    void swap(SampleSeries& other) {
+        xs.swap(other.xs);
+        ys.swap(other.ys);
+        std::swap(uniform, other.uniform);
+        std::swap(x0, other.x0);
+        std::swap(dx, other.dx);
+    }
+
+    double x(size_t i) const { return uniform ? x0 + i * dx : xs[i]; }
+    double y(size_t i) const { return ys[i]; }
+
+    Point operator[](size_t i) const { return Point(x(i), ys[i]); }
+    Point front() const { return (*this)[0]; }
+    Point back() const { return (*this)[size() - 1]; }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+
+    // Writes x values of [first, first + n) into out, generating them for a
+    // uniform series.
+    void expandX(size_t first, size_t n, double* out) const {
+        if (uniform) {
+            for (size_t i = 0; i < n; ++i) {
+                out[i] = x0 + (first + i) * dx;
+            }
+        }
+        else {
+            std::memcpy(out, xs.data() + first, n * sizeof(double));
         }
+    }
+
+    SeriesChunk chunk(size_t first, size_t count) const {
+        SeriesChunk result = { first, count, uniform ? nullptr : xs.data() + first, x0, dx, ys.data() + first };
         return result;
     }
 
-    std::string getFormula() override {
-        return "Polynomial Function";
+    size_t memoryBytes() const {
+        return (xs.size() + ys.size()) * sizeof(double);
     }
+
+    bool usesLargePages() const {
+        return ys.usesLargePages();
+    }
+
+    // Explicit x storage; nullptr for a uniform series.
+    double* xData() { return uniform ? nullptr : xs.data(); }
+    const double* xData() const { return uniform ? nullptr : xs.data(); }
+    double* yData() { return ys.data(); }
+    const double* yData() const { return ys.data(); }
 };
 
-class TrigonometricFunction : public Function {
+// Min/max of values[0, n), ignoring NaN. Returns Range(+inf, -inf) if there
+// is no number at all.
+inline Range minMaxKernel(const double* values, size_t n) {
+    double lo = INFINITY, hi = -INFINITY;
+    size_t i = 0;
+#ifdef PLOTTER_SSE2
+    // minpd/maxpd return the second operand when either one is NaN, so
+    // passing the accumulator second drops NaN samples.
+    __m128d vlo = _mm_set1_pd(INFINITY), vhi = _mm_set1_pd(-INFINITY);
+    for (; i + 2 <= n; i += 2) {
+        __m128d v = _mm_loadu_pd(values + i);
+        vlo = _mm_min_pd(v, vlo);
+        vhi = _mm_max_pd(v, vhi);
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, vlo);
+    lo = std::min(lanes[0], lanes[1]);
+    _mm_storeu_pd(lanes, vhi);
+    hi = std::max(lanes[0], lanes[1]);
+#endif
+    for (; i < n; ++i) {
+        if (values[i] < lo) lo = values[i];
+        if (values[i] > hi) hi = values[i];
+    }
+    return Range(lo, hi);
+}
+
+// out[i] = float(in[i] * scale + offset): world to screen coordinates for one axis.
+inline void affineTransformKernel(const double* in, size_t n, double scale, double offset, float* out) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = static_cast<float>(in[i] * scale + offset);
+    }
+}
+
+// Same transform for the implicit x of a uniform series, without
+// materializing x: out[i] = float((x0 + i * dx) * scale + offset).
+inline void uniformTransformKernel(double x0, double dx, size_t n, double scale, double offset, float* out) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = static_cast<float>((x0 + i * dx) * scale + offset);
+    }
+}
+
+// Screen coordinates of a chunk's x values, implicit or explicit.
+inline void transformX(const SeriesChunk& chunk, double scale, double offset, float* out) {
+    if (chunk.xs) {
+        affineTransformKernel(chunk.xs, chunk.count, scale, offset, out);
+    }
+    else {
+        uniformTransformKernel(chunk.x0 + chunk.first * chunk.dx, chunk.dx, chunk.count, scale, offset, out);
+    }
+}
+
+// Unit normals of the segments of a polyline, measured after scaling each
+// axis: (nx[i], ny[i]) is perpendicular to point i -> i + 1. Zero-length
+// segments get (0, 0).
+inline void segmentNormalsKernel(const float* xs, const float* ys, size_t n, float scaleX, float scaleY,
+    float* nx, float* ny) {
+    size_t segments = n > 0 ? n - 1 : 0;
+    size_t i = 0;
+#ifdef PLOTTER_SSE2
+    const __m128 sx = _mm_set1_ps(scaleX), sy = _mm_set1_ps(scaleY), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    for (; i + 4 <= segments; i += 4) {
+        __m128 dx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(xs + i + 1), _mm_loadu_ps(xs + i)), sx);
+        __m128 dy = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(ys + i + 1), _mm_loadu_ps(ys + i)), sy);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+        // 1/0 is inf; the mask turns it into 0 for zero-length segments
+        __m128 inverse = _mm_and_ps(_mm_cmpgt_ps(length, zero), _mm_div_ps(one, length));
+        _mm_storeu_ps(nx + i, _mm_mul_ps(_mm_sub_ps(zero, dy), inverse));
+        _mm_storeu_ps(ny + i, _mm_mul_ps(dx, inverse));
+    }
+#endif
+    for (; i < segments; ++i) {
+        float dx = (xs[i + 1] - xs[i]) * scaleX, dy = (ys[i + 1] - ys[i]) * scaleY;
+        float length = std::sqrt(dx * dx + dy * dy);
+        float inverse = length > 0 ? 1.0f / length : 0.0f;
+        nx[i] = -dy * inverse;
+        ny[i] = dx * inverse;
+    }
+}
+
+// Lossy block codec for one channel of doubles. Every block of kBlockSize
+// values is quantized to integer levels between the block's min and max
+// and stored as deltas between consecutive levels: int16 when all deltas
+// fit, int32 otherwise. Blocks containing NaN or infinity are kept as raw
+// doubles. The per-block min/max header gives exact bounds without decoding.
+class QuantizedChannel {
+public:
+    static const size_t kBlockSize = 256;
+
 private:
-    std::string type;
-    double amplitude, frequency, phaseShift;
+    struct Block {
+        double minValue, maxValue;
+        double scale;  // value = minValue + level * scale
+        int32_t firstLevel; // deltas start from this level
+        size_t offset; // byte offset of the payload
+        int width;     // bits per stored delta: 16, 32, or 64 for raw doubles
+    };
+    std::vector<Block> blocks;
+    AlignedArray<unsigned char> payload;
+    size_t count = 0;
+
 public:
-    TrigonometricFunction(std::string type, double amplitude, double frequency, double phaseShift)
-        : type(type), amplitude(amplitude), frequency(frequency), phaseShift(phaseShift) {
+    // precisionBits: 16 keeps 65535 levels per block, 32 keeps 2^31 - 1.
+    void encode(const double* values, size_t n, int precisionBits) {
+        const double levels = precisionBits >= 32 ? 2147483647.0 : 65535.0;
+        size_t blockCount = (n + kBlockSize - 1) / kBlockSize;
+        std::vector<int32_t> deltas(n);
+        blocks.assign(blockCount, Block());
+        count = n;
+
+        size_t bytes = 0;
+        for (size_t b = 0; b < blockCount; ++b) {
+            size_t first = b * kBlockSize, last = std::min(first + kBlockSize, n);
+            Block& block = blocks[b];
+            bool finite = true;
+            for (size_t i = first; i < last; ++i) {
+                finite = finite && std::isfinite(values[i]);
+            }
+            Range bounds = minMaxKernel(values + first, last - first);
+            block.minValue = bounds.min;
+            block.maxValue = bounds.max;
+            block.width = 64;
+            // Blocks with NaN/inf, or whose span overflows a double (huge
+            // values of both signs), are stored raw
+            if (finite && std::isfinite(bounds.max - bounds.min)) {
+                block.scale = bounds.max > bounds.min ? (bounds.max - bounds.min) / levels : 0.0;
+                int64_t previous = -1;
+                bool narrow = true;
+                for (size_t i = first; i < last; ++i) {
+                    int64_t level = block.scale > 0 ? std::llround((values[i] - bounds.min) / block.scale) : 0;
+                    level = std::min<int64_t>(std::max<int64_t>(level, 0), static_cast<int64_t>(levels));
+                    if (previous < 0) {
+                        block.firstLevel = static_cast<int32_t>(level);
+                        previous = level;
+                    }
+                    deltas[i] = static_cast<int32_t>(level - previous);
+                    narrow = narrow && deltas[i] >= -32768 && deltas[i] <= 32767;
+                    previous = level;
+                }
+                block.width = narrow ? 16 : 32;
+            }
+            block.offset = bytes;
+            bytes += ((last - first) * block.width / 8 + 7) & ~size_t(7); // keep payloads 8-byte aligned
+        }
+
+        payload.resize(bytes);
+        for (size_t b = 0; b < blockCount; ++b) {
+            size_t first = b * kBlockSize, last = std::min(first + kBlockSize, n);
+            const Block& block = blocks[b];
+            unsigned char* out = payload.data() + block.offset;
+            if (block.width == 64) {
+                std::memcpy(out, values + first, (last - first) * sizeof(double));
+            }
+            else if (block.width == 32) {
+                std::memcpy(out, deltas.data() + first, (last - first) * sizeof(int32_t));
+            }
+            else {
+                int16_t* narrow = reinterpret_cast<int16_t*>(out);
+                for (size_t i = first; i < last; ++i) {
+                    narrow[i - first] = static_cast<int16_t>(deltas[i]);
+                }
+            }
+        }
+    }
+
+    size_t size() const { return count; }
+    size_t getBlockCount() const { return blocks.size(); }
+    size_t blockLength(size_t b) const { return std::min(kBlockSize, count - b * kBlockSize); }
+    Range blockBounds(size_t b) const { return Range(blocks[b].minValue, blocks[b].maxValue); }
+
+    Range bounds() const {
+        Range result(INFINITY, -INFINITY);
+        for (const auto& block : blocks) {
+            result = Range(std::min(result.min, block.minValue), std::max(result.max, block.maxValue));
+        }
+        return result;
+    }
+
+    size_t memoryBytes() const {
+        return payload.size() + blocks.size() * sizeof(Block);
+    }
+
+    // Decodes block b into out[0, blockLength(b)). The delta prefix sum is
+    // a short scalar pass over integers; the dequantization pass is a plain
+    // multiply-add the compiler vectorizes.
+    void decodeBlock(size_t b, double* out) const {
+        const Block& block = blocks[b];
+        size_t n = blockLength(b);
+        const unsigned char* in = payload.data() + block.offset;
+        if (block.width == 64) {
+            std::memcpy(out, in, n * sizeof(double));
+            return;
+        }
+        int32_t levels[kBlockSize];
+        int32_t level = block.firstLevel;
+        if (block.width == 16) {
+            const int16_t* deltas = reinterpret_cast<const int16_t*>(in);
+            for (size_t i = 0; i < n; ++i) {
+                level += deltas[i];
+                levels[i] = level;
+            }
+        }
+        else {
+            const int32_t* deltas = reinterpret_cast<const int32_t*>(in);
+            for (size_t i = 0; i < n; ++i) {
+                level += deltas[i];
+                levels[i] = level;
+            }
+        }
+        const double minValue = block.minValue, scale = block.scale;
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = minValue + levels[i] * scale;
+        }
+    }
+};
+
+const size_t QuantizedChannel::kBlockSize;
+
+// Compressed, read-only form of a SampleSeries for archived or background
+// graphs. Implicit x stays implicit; explicit x and all y go through
+// QuantizedChannel.
+class CompactSeries {
+private:
+    bool uniform = false;
+    double x0 = 0, dx = 0;
+    QuantizedChannel xs, ys;
+
+public:
+    void encode(const SampleSeries& series, int precisionBits) {
+        uniform = series.isUniform();
+        x0 = series.getX0();
+        dx = series.getDx();
+        xs = QuantizedChannel();
+        if (!uniform) {
+            xs.encode(series.xData(), series.size(), precisionBits);
+        }
+        ys.encode(series.yData(), series.size(), precisionBits);
+    }
+
+    void decode(SampleSeries& out) const {
+        size_t n = ys.size();
+        if (uniform) {
+            out.assignUniform(x0, dx, n);
+        }
+        else {
+            out.resize(n);
+        }
+        for (size_t b = 0; b < ys.getBlockCount(); ++b) {
+            if (!uniform) {
+                xs.decodeBlock(b, out.xData() + b * QuantizedChannel::kBlockSize);
+            }
+            ys.decodeBlock(b, out.yData() + b * QuantizedChannel::kBlockSize);
+        }
+    }
+
+    size_t size() const { return ys.size(); }
+    bool empty() const { return ys.size() == 0; }
+
+    Range xBounds() const {
+        if (!uniform) {
+            return xs.bounds();
+        }
+        if (empty()) {
+            return Range(INFINITY, -INFINITY);
+        }
+        double last = x0 + (size() - 1) * dx;
+        return Range(std::min(x0, last), std::max(x0, last));
+    }
+
+    Range yBounds() const { return ys.bounds(); }
+
+    size_t memoryBytes() const {
+        return xs.memoryBytes() + ys.memoryBytes();
+    }
+
+    // Decodes one block at a time into stack buffers and hands each block
+    // to visitor as a SeriesChunk, so nothing larger than a block is ever
+    // materialized.
+    template <typename Visitor>
+    void visit(const Visitor& visitor) const {
+        double xBuffer[QuantizedChannel::kBlockSize], yBuffer[QuantizedChannel::kBlockSize];
+        for (size_t b = 0; b < ys.getBlockCount(); ++b) {
+            size_t first = b * QuantizedChannel::kBlockSize;
+            size_t n = ys.blockLength(b);
+            if (!uniform) {
+                xs.decodeBlock(b, xBuffer);
+            }
+            ys.decodeBlock(b, yBuffer);
+            SeriesChunk chunk = { first, n, uniform ? nullptr : xBuffer, x0, dx, yBuffer };
+            visitor(chunk);
+        }
+    }
+};
+
+// Work-stealing thread pool shared by sampling, file parsing and rendering.
+// Each worker owns a deque: it pushes and pops its own tasks at the back and
+// steals from the front of other workers' deques when it runs dry. Threads
+// outside the pool submit into a shared injection queue. A thread waiting in
+// TaskGroup::wait() runs pending tasks instead of blocking, so nested
+// parallelism reuses the same workers and never oversubscribes the machine.
+class TaskScheduler {
+public:
+    typedef std::function<void()> Task;
+
+    explicit TaskScheduler(unsigned workerCount)
+        : workerCount(workerCount), queuedCount(0), stopping(false),
+          busyNanos(workerCount + 1), taskCounts(workerCount + 1), stealCounts(workerCount + 1),
+          statsStart(std::chrono::steady_clock::now()) {
+        for (unsigned i = 0; i <= workerCount; ++i) {
+            queues.emplace_back(new WorkQueue());
+        }
+        for (unsigned i = 0; i < workerCount; ++i) {
+            workers.emplace_back(&TaskScheduler::workerLoop, this, i);
+        }
+    }
+
+    ~TaskScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // One thread is left for the main loop; it still helps out while waiting.
+    static TaskScheduler& instance() {
+        static TaskScheduler scheduler(std::max(2u, std::thread::hardware_concurrency()) - 1);
+        return scheduler;
+    }
+
+    unsigned getWorkerCount() const { return workerCount; }
+
+    void submit(Task task) {
+        unsigned index = currentWorker();
+        {
+            WorkQueue& queue = *queues[index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        ++queuedCount;
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wakeup.notify_one();
+    }
+
+    // Runs a task on the calling thread, counted in the utilization stats.
+    void runHere(Task& task) {
+        execute(currentWorker(), task);
+    }
+
+    void resetStats() {
+        for (unsigned i = 0; i <= workerCount; ++i) {
+            busyNanos[i] = 0;
+            taskCounts[i] = 0;
+            stealCounts[i] = 0;
+        }
+        statsStart = std::chrono::steady_clock::now();
+    }
+
+    // Share of wall time each worker spent running tasks since the last reset.
+    // The last row covers threads outside the pool that helped while waiting.
+    void reportUtilization(std::ostream& out) const {
+        double wallNanos = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - statsStart).count();
+        for (unsigned i = 0; i <= workerCount; ++i) {
+            if (i < workerCount) {
+                out << "  worker " << i;
+            }
+            else {
+                out << "  callers ";
+            }
+            out << ": " << 100.0 * busyNanos[i] / wallNanos << "% busy, "
+                << taskCounts[i] << " tasks, " << stealCounts[i] << " steals\n";
+        }
+    }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    unsigned workerCount;
+    std::vector<std::unique_ptr<WorkQueue>> queues; // queues[workerCount] is the injection queue
+    std::vector<std::thread> workers;
+    std::atomic<int> queuedCount;
+    bool stopping;
+    std::mutex sleepMutex;
+    std::condition_variable wakeup;
+
+    std::vector<std::atomic<long long>> busyNanos;
+    std::vector<std::atomic<long long>> taskCounts;
+    std::vector<std::atomic<long long>> stealCounts;
+    std::chrono::steady_clock::time_point statsStart;
+
+    static thread_local TaskScheduler* tlsScheduler;
+    static thread_local unsigned tlsWorker;
+    static thread_local int tlsDepth;
+
+    unsigned currentWorker() const {
+        return tlsScheduler == this ? tlsWorker : workerCount;
+    }
+
+    bool popBack(unsigned index, Task& task) {
+        WorkQueue& queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool popFront(unsigned index, Task& task) {
+        WorkQueue& queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    bool findTask(unsigned index, Task& task) {
+        if (queuedCount == 0) {
+            return false;
+        }
+        // Own work first (newest, still warm in cache), then the injection
+        // queue in FIFO order, then the oldest task of another worker.
+        bool found = (index < workerCount && popBack(index, task)) || popFront(workerCount, task);
+        for (unsigned i = 1; !found && i <= workerCount; ++i) {
+            unsigned victim = (index + i) % (workerCount + 1);
+            if (victim != workerCount && victim != index && popFront(victim, task)) {
+                found = true;
+                ++stealCounts[index];
+            }
+        }
+        if (found) {
+            --queuedCount;
+        }
+        return found;
+    }
+
+    void execute(unsigned index, Task& task) {
+        // Tasks run while waiting inside another task are already covered
+        // by the outer task's time.
+        bool outermost = tlsDepth++ == 0;
+        auto start = std::chrono::steady_clock::now();
+        task();
+        if (outermost) {
+            busyNanos[index] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        }
+        --tlsDepth;
+        ++taskCounts[index];
+    }
+
+    void workerLoop(unsigned index) {
+        tlsScheduler = this;
+        tlsWorker = index;
+        while (true) {
+            Task task;
+            if (findTask(index, task)) {
+                execute(index, task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeup.wait(lock, [this]() { return stopping || queuedCount > 0; });
+            if (stopping && queuedCount == 0) {
+                return;
+            }
+        }
+    }
+};
+
+thread_local TaskScheduler* TaskScheduler::tlsScheduler = nullptr;
+thread_local unsigned TaskScheduler::tlsWorker = 0;
+thread_local int TaskScheduler::tlsDepth = 0;
+
+// Fork/join: run() forks a task, wait() joins all of them, executing the
+// group's own unstarted tasks on the waiting thread in the meantime. Only
+// its own: a render frame waiting on a parallelFor must not pick up a
+// long background job that happens to sit in the same scheduler queue.
+class TaskGroup {
+private:
+    // Shared with the scheduler entries, which may outlive the group once
+    // wait() has run their task itself.
+    struct State {
+        std::mutex mutex;
+        std::deque<TaskScheduler::Task> unstarted;
+        std::atomic<int> pending;
+        State() : pending(0) {}
+    };
+
+    TaskScheduler& scheduler;
+    std::shared_ptr<State> state;
+
+    // helper is the scheduler when called from wait(), so the task is
+    // counted as help from the waiting thread; nullptr on a worker.
+    static bool runOne(State& state, TaskScheduler* helper) {
+        TaskScheduler::Task task;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if (state.unstarted.empty()) {
+                return false;
+            }
+            task = std::move(state.unstarted.front());
+            state.unstarted.pop_front();
+        }
+        if (helper) {
+            helper->runHere(task);
+        }
+        else {
+            task();
+        }
+        --state.pending;
+        return true;
+    }
+
+public:
+    explicit TaskGroup(TaskScheduler& scheduler = TaskScheduler::instance())
+        : scheduler(scheduler), state(std::make_shared<State>()) {}
+
+    ~TaskGroup() {
+        wait();
+    }
+
+    void run(TaskScheduler::Task task) {
+        ++state->pending;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->unstarted.push_back(std::move(task));
+        }
+        // Each entry runs whichever task of the group is next, if any is left
+        std::shared_ptr<State> shared = state;
+        scheduler.submit([shared]() { runOne(*shared, nullptr); });
+    }
+
+    void wait() {
+        while (state->pending > 0) {
+            if (!runOne(*state, &scheduler)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+};
+
+// Calls body(first, last) for consecutive slices of [begin, end) of at most
+// grain elements each, in parallel, and returns when all slices are done.
+template <typename Body>
+void parallelFor(int begin, int end, int grain, const Body& body,
+    TaskScheduler& scheduler = TaskScheduler::instance()) {
+    if (end - begin <= grain || scheduler.getWorkerCount() == 0) {
+        body(begin, end);
+        return;
+    }
+    TaskGroup group(scheduler);
+    for (int first = begin; first < end; first += grain) {
+        int last = std::min(first + grain, end);
+        group.run([&body, first, last]() { body(first, last); });
+    }
+    group.wait();
+}
+
+// Generation-based cancellation: the owner bumps a shared counter for every
+// new request, and work started for an older generation sees itself stale.
+class CancellationToken {
+private:
+    std::shared_ptr<const std::atomic<unsigned>> latest;
+    unsigned generation;
+public:
+    CancellationToken() : generation(0) {}
+    CancellationToken(std::shared_ptr<const std::atomic<unsigned>> latest, unsigned generation)
+        : latest(latest), generation(generation) {}
+
+    bool isCancelled() const {
+        return latest && latest->load() != generation;
+    }
+};
+
+// One fixed-size page of a PagedSeries, resident in memory.
+struct SeriesPage {
+    AlignedArray<double> xs, ys;
+
+    size_t memoryBytes() const {
+        return (xs.size() + ys.size()) * sizeof(double);
+    }
+};
+
+class PagedSeries;
+
+// Process-wide LRU cache of series pages with a memory cap. Pages are
+// handed out as shared_ptr, so a page evicted while a reader still uses it
+// stays valid until that reader lets go.
+class PageCache {
+private:
+    struct Entry {
+        uint64_t key;
+        std::shared_ptr<const SeriesPage> page;
+    };
+
+    mutable std::mutex mutex;
+    std::list<Entry> lru; // most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    size_t capacity = 256u << 20;
+    size_t usage = 0;
+
+    static uint64_t makeKey(unsigned seriesId, size_t page) {
+        return (static_cast<uint64_t>(seriesId) << 40) | page;
+    }
+
+    void evictToCapacity() {
+        while (usage > capacity && lru.size() > 1) {
+            usage -= lru.back().page->memoryBytes();
+            index.erase(lru.back().key);
+            lru.pop_back();
+        }
+    }
+
+public:
+    static PageCache& instance() {
+        static PageCache cache;
+        return cache;
+    }
+
+    void setCapacity(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        capacity = bytes;
+        evictToCapacity();
+    }
+
+    size_t getCapacity() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return capacity;
+    }
+
+    size_t getUsage() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return usage;
+    }
+
+    // Cached page, or nullptr.
+    std::shared_ptr<const SeriesPage> find(unsigned seriesId, size_t page) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = index.find(makeKey(seriesId, page));
+        if (found == index.end()) {
+            return nullptr;
+        }
+        lru.splice(lru.begin(), lru, found->second);
+        return found->second->page;
+    }
+
+    void insert(unsigned seriesId, size_t page, std::shared_ptr<const SeriesPage> data) {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t key = makeKey(seriesId, page);
+        if (index.count(key)) {
+            return; // loaded concurrently by someone else
+        }
+        usage += data->memoryBytes();
+        lru.push_front({ key, std::move(data) });
+        index[key] = lru.begin();
+        evictToCapacity();
+    }
+
+    // Frees the memory of pages nobody is reading right now.
+    size_t trim(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t freed = 0;
+        for (auto it = lru.end(); it != lru.begin() && freed < bytes;) {
+            --it;
+            if (it->page.use_count() == 1) {
+                freed += it->page->memoryBytes();
+                usage -= it->page->memoryBytes();
+                index.erase(it->key);
+                it = lru.erase(it);
+            }
+        }
+        return freed;
+    }
+};
+
+// Series backed by a file too large for RAM. The file holds a header, fixed
+// pages of kPagePoints samples (x array then y array, the last page padded)
+// and a footer table with every page's x/y bounds. Only the table lives in
+// memory; pages are read through PageCache on demand.
+class PagedSeries : public std::enable_shared_from_this<PagedSeries> {
+public:
+    static const size_t kPagePoints = 65536; // 1 MB per page
+    static const size_t kPageBytes = kPagePoints * 2 * sizeof(double);
+
+private:
+    struct FileHeader {
+        char magic[8];
+        uint64_t count;
+        uint64_t pagePoints;
+        uint64_t tableOffset;
+    };
+
+    struct PageInfo {
+        double xMin, xMax, yMin, yMax;
+    };
+
+    std::string path;
+    unsigned id;
+    size_t count = 0;
+    std::vector<PageInfo> pages;
+    bool temporary = false; // file is deleted with the series
+
+    mutable std::mutex prefetchMutex;
+    mutable std::vector<bool> queued;            // pages with a background read in flight
+    mutable Range prefetched = Range(NAN, NAN);  // window of the last prefetch
+
+    static unsigned nextId() {
+        static std::atomic<unsigned> counter(0);
+        return ++counter;
+    }
+
+    static uint64_t pageOffset(size_t page) {
+        return sizeof(FileHeader) + static_cast<uint64_t>(page) * kPagePoints * 2 * sizeof(double);
+    }
+
+    // nullptr if the page could not be read in full.
+    std::shared_ptr<const SeriesPage> readPage(size_t page) const {
+        std::shared_ptr<SeriesPage> data = std::make_shared<SeriesPage>();
+        size_t n = pageLength(page);
+        data->xs.resize(n);
+        data->ys.resize(n);
+        std::ifstream file(path, std::ios::binary);
+        file.seekg(static_cast<std::streamoff>(pageOffset(page)));
+        file.read(reinterpret_cast<char*>(data->xs.data()), n * sizeof(double));
+        file.seekg(static_cast<std::streamoff>(pageOffset(page) + kPagePoints * sizeof(double)));
+        file.read(reinterpret_cast<char*>(data->ys.data()), n * sizeof(double));
+        if (!file) {
+            std::cerr << "Error reading page " << page << " of " << path << std::endl;
+            return nullptr;
+        }
+        return data;
+    }
+
+    size_t pageLength(size_t page) const {
+        return std::min(kPagePoints, count - page * kPagePoints);
+    }
+
+    bool pageInWindow(size_t page, Range xWindow) const {
+        return pages[page].xMin <= xWindow.max && pages[page].xMax >= xWindow.min;
+    }
+
+    // First and last page overlapping xWindow; false if none does.
+    bool pageSpan(Range xWindow, size_t& first, size_t& last) const {
+        first = pages.size();
+        last = 0;
+        for (size_t p = 0; p < pages.size(); ++p) {
+            if (pageInWindow(p, xWindow)) {
+                first = std::min(first, p);
+                last = std::max(last, p);
+            }
+        }
+        return first <= last;
+    }
+
+    static size_t cachePages() {
+        return std::max<size_t>(1, PageCache::instance().getCapacity() / kPageBytes);
+    }
+
+    void prefetchPage(size_t page) const {
+        getPage(page);
+        std::lock_guard<std::mutex> lock(prefetchMutex);
+        queued[page] = false;
+    }
+
+public:
+    PagedSeries() : id(nextId()) {}
+
+    ~PagedSeries() {
+        if (temporary) {
+            std::remove(path.c_str());
+        }
+    }
+
+    // Makes the file scratch space owned by this series, e.g. data spilled
+    // from memory.
+    void setTemporary(bool isTemporary) {
+        temporary = isTemporary;
+    }
+
+    // Writes the samples of any object with visitSamples() into a paged
+    // file, streaming one page at a time.
+    template <typename Source>
+    static bool write(const std::string& path, const Source& source) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        FileHeader header = { { 'P', 'L', 'O', 'T', 'P', 'G', '1', '\0' }, 0, kPagePoints, 0 };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        std::vector<PageInfo> table;
+        std::vector<double> xs, ys;
+        xs.reserve(kPagePoints);
+        ys.reserve(kPagePoints);
+        auto flush = [&]() {
+            Range xBounds = minMaxKernel(xs.data(), xs.size());
+            Range yBounds = minMaxKernel(ys.data(), ys.size());
+            table.push_back({ xBounds.min, xBounds.max, yBounds.min, yBounds.max });
+            xs.resize(kPagePoints, 0.0);
+            ys.resize(kPagePoints, 0.0);
+            file.write(reinterpret_cast<const char*>(xs.data()), kPagePoints * sizeof(double));
+            file.write(reinterpret_cast<const char*>(ys.data()), kPagePoints * sizeof(double));
+            xs.clear();
+            ys.clear();
+        };
+        source.visitSamples([&](const SeriesChunk& chunk) {
+            for (size_t i = 0; i < chunk.count; ++i) {
+                xs.push_back(chunk.x(i));
+                ys.push_back(chunk.ys[i]);
+                ++header.count;
+                if (xs.size() == kPagePoints) {
+                    flush();
+                }
+            }
+        });
+        if (!xs.empty()) {
+            flush();
+        }
+
+        header.tableOffset = pageOffset(table.size());
+        file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(PageInfo));
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        return static_cast<bool>(file);
+    }
+
+    // nullptr if the file is missing or not a paged series.
+    static std::shared_ptr<PagedSeries> open(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        FileHeader header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+            || std::memcmp(header.magic, "PLOTPG1", 8) != 0 || header.pagePoints != kPagePoints) {
+            std::cerr << "Not a paged series file: " << path << std::endl;
+            return nullptr;
+        }
+        std::shared_ptr<PagedSeries> series = std::make_shared<PagedSeries>();
+        series->path = path;
+        series->count = static_cast<size_t>(header.count);
+        series->pages.resize((series->count + kPagePoints - 1) / kPagePoints);
+        series->queued.resize(series->pages.size());
+        file.seekg(static_cast<std::streamoff>(header.tableOffset));
+        file.read(reinterpret_cast<char*>(series->pages.data()), series->pages.size() * sizeof(PageInfo));
+        if (!file) {
+            std::cerr << "Truncated paged series file: " << path << std::endl;
+            return nullptr;
+        }
+        return series;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    size_t getPageCount() const { return pages.size(); }
+
+    Range xBounds() const {
+        Range result(INFINITY, -INFINITY);
+        for (const auto& page : pages) {
+            result = Range(std::min(result.min, page.xMin), std::max(result.max, page.xMax));
+        }
+        return result;
+    }
+
+    Range yBounds() const {
+        Range result(INFINITY, -INFINITY);
+        for (const auto& page : pages) {
+            result = Range(std::min(result.min, page.yMin), std::max(result.max, page.yMax));
+        }
+        return result;
+    }
+
+    // Resident page, read from disk (blocking) on a cache miss; nullptr if
+    // the read failed. Failed reads are not cached and are retried.
+    std::shared_ptr<const SeriesPage> getPage(size_t page) const {
+        std::shared_ptr<const SeriesPage> data = PageCache::instance().find(id, page);
+        if (!data) {
+            data = readPage(page);
+            if (data) {
+                PageCache::instance().insert(id, page, data);
+            }
+        }
+        return data;
+    }
+
+    // True when the pages overlapping xWindow do not fit in the page cache
+    // together: reading them would evict them again before the frame is
+    // drawn. Such a view is drawn from the page table (visitEnvelope).
+    bool exceedsCache(Range xWindow) const {
+        size_t first, last;
+        return pageSpan(xWindow, first, last) && last - first + 1 > cachePages();
+    }
+
+    // Starts background reads for the pages overlapping xWindow and up to
+    // readAhead pages on each side of them, which a pan will need next.
+    // Called every frame: does nothing until the window moves, and never
+    // queues a page twice or more pages than the cache holds.
+    void prefetch(Range xWindow, size_t readAhead = 2) const {
+        {
+            std::lock_guard<std::mutex> lock(prefetchMutex);
+            if (xWindow.min == prefetched.min && xWindow.max == prefetched.max) {
+                return;
+            }
+            prefetched = xWindow;
+        }
+        size_t first, last, capacity = cachePages();
+        if (!pageSpan(xWindow, first, last) || last - first + 1 > capacity) {
+            return;
+        }
+        readAhead = std::min(readAhead, (capacity - (last - first + 1)) / 2);
+        first = first > readAhead ? first - readAhead : 0;
+        last = std::min(last + readAhead, pages.size() - 1);
+        std::shared_ptr<const PagedSeries> self = shared_from_this();
+        for (size_t p = first; p <= last; ++p) {
+            if (PageCache::instance().find(id, p)) {
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(prefetchMutex);
+                if (queued[p]) {
+                    continue;
+                }
+                queued[p] = true;
+            }
+            TaskScheduler::instance().submit([self, p]() { self->prefetchPage(p); });
+        }
+    }
+
+    // Hands each page overlapping xWindow to visitor as a SeriesChunk.
+    // Pages that cannot be read are skipped.
+    template <typename Visitor>
+    void visit(const Visitor& visitor, Range xWindow = Range(-INFINITY, INFINITY)) const {
+        for (size_t p = 0; p < pages.size(); ++p) {
+            if (!pageInWindow(p, xWindow)) {
+                continue;
+            }
+            std::shared_ptr<const SeriesPage> page = getPage(p);
+            if (!page) {
+                continue;
+            }
+            SeriesChunk chunk = { p * kPagePoints, page->ys.size(), page->xs.data(), 0, 0, page->ys.data() };
+            visitor(chunk);
+        }
+    }
+
+    // Hands visitor the envelope of the pages overlapping xWindow, built
+    // from the page table alone: each page becomes a stroke from its
+    // minimum to its maximum at its centre. Nothing is read from disk.
+    template <typename Visitor>
+    void visitEnvelope(const Visitor& visitor, Range xWindow) const {
+        std::vector<double> xs, ys;
+        for (size_t p = 0; p < pages.size(); ++p) {
+            if (!pageInWindow(p, xWindow)) {
+                continue;
+            }
+            double x = pages[p].xMin + (pages[p].xMax - pages[p].xMin) / 2;
+            xs.push_back(x);
+            xs.push_back(x);
+            ys.push_back(pages[p].yMin);
+            ys.push_back(pages[p].yMax);
+        }
+        if (!ys.empty()) {
+            SeriesChunk chunk = { 0, ys.size(), xs.data(), 0, 0, ys.data() };
+            visitor(chunk);
+        }
+    }
+};
+
+const size_t PagedSeries::kPagePoints;
+const size_t PagedSeries::kPageBytes;
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Capacity is rounded up to a power of two. Each side keeps a
+// cached copy of the other side's index, so the shared cache lines are only
+// touched when the cached view says the queue is full or empty.
+template <typename T>
+class SpscRing {
+private:
+    // Three groups kept a full cache line apart, so they never share one
+    // wherever the ring lands in memory (C++14 new ignores alignas): the
+    // read-only storage both sides use, the consumer's and the producer's.
+    AlignedArray<T> slots;
+    size_t mask;
+    char readOnlyPadding[64];
+
+    // Consumer
+    std::atomic<size_t> head;
+    size_t cachedTail = 0;
+    char consumerPadding[64];
+
+    // Producer
+    std::atomic<size_t> tail;
+    size_t cachedHead = 0;
+    char producerPadding[64];
+
+public:
+    explicit SpscRing(size_t capacity) : head(0), tail(0) {
+        size_t rounded = 1;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+        slots.resize(rounded);
+        mask = rounded - 1;
+    }
+
+    // Producer only. False if the queue is full.
+    bool tryPush(const T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cachedHead > mask) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t - cachedHead > mask) {
+                return false;
+            }
+        }
+        slots[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Calls consumer(const T*, count) with up to maxItems
+    // queued items in at most two contiguous runs and returns how many were
+    // taken.
+    template <typename Consumer>
+    size_t consume(const Consumer& consumer, size_t maxItems) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (cachedTail == h) {
+            cachedTail = tail.load(std::memory_order_acquire);
+        }
+        size_t available = std::min(cachedTail - h, maxItems);
+        size_t first = std::min(available, slots.size() - (h & mask));
+        if (first > 0) {
+            consumer(slots.data() + (h & mask), first);
+        }
+        if (available > first) {
+            consumer(slots.data(), available - first);
+        }
+        head.store(h + available, std::memory_order_release);
+        return available;
+    }
+};
+
+// Fixed-capacity series fed live by a producer thread. The producer calls
+// push(); the render thread calls drain() once per frame, which moves the
+// queued samples into a ring holding the latest windowPoints samples, and
+// then reads that window without any locks.
+class LiveSeries {
+private:
+    SpscRing<Point> input;
+    AlignedArray<double> xs, ys; // ring storage of the window
+    size_t next = 0;             // ring slot of the next sample
+    size_t count = 0;
+    size_t total = 0;            // samples drained since creation
+    std::atomic<size_t> dropped; // pushes rejected because the queue was full
+
+public:
+    explicit LiveSeries(size_t windowPoints, size_t queuePoints = 1u << 18)
+        : input(queuePoints), dropped(0) {
+        xs.resize(windowPoints);
+        ys.resize(windowPoints);
+    }
+
+    // Producer side. Never blocks; a full queue drops the sample.
+    bool push(double x, double y) {
+        if (!input.tryPush(Point(x, y))) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    size_t getDropped() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    // Consumer side: takes everything queued so far. Returns the number of
+    // new samples.
+    size_t drain() {
+        size_t capacity = xs.size();
+        size_t taken = input.consume([this, capacity](const Point* items, size_t n) {
+            // Only the newest capacity samples of a large batch survive
+            if (n > capacity) {
+                items += n - capacity;
+                n = capacity;
+            }
+            for (size_t i = 0; i < n; ++i) {
+                xs[next] = items[i].x;
+                ys[next] = items[i].y;
+                if (++next == capacity) {
+                    next = 0;
+                }
+            }
+        }, std::numeric_limits<size_t>::max());
+        count = std::min(count + taken, capacity);
+        total += taken;
+        return taken;
+    }
+
+    size_t size() const { return count; }
+    size_t getCapacity() const { return xs.size(); }
+    size_t getTotal() const { return total; }
+
+    size_t memoryBytes() const {
+        return (xs.size() + ys.size()) * sizeof(double);
+    }
+
+    // Newest sample; the window must not be empty.
+    Point latest() const {
+        size_t last = next == 0 ? xs.size() - 1 : next - 1;
+        return Point(xs[last], ys[last]);
+    }
+
+    // Hands the window to visitor oldest first, as at most two chunks.
+    template <typename Visitor>
+    void visit(const Visitor& visitor) const {
+        size_t start = count < xs.size() ? 0 : next;
+        size_t first = std::min(count, xs.size() - start);
+        if (first > 0) {
+            visitor(SeriesChunk{ 0, first, xs.data() + start, 0, 0, ys.data() + start });
+        }
+        if (count > first) {
+            visitor(SeriesChunk{ first, count - first, xs.data(), 0, 0, ys.data() });
+        }
+    }
+};
+
+class Function {
+public:
+    virtual double evaluate(double x) = 0;
+    virtual std::string getFormula() = 0;
+    // Relative cost of one evaluate() call, used to balance parallel sampling.
+    virtual double estimateCost() const { return 1.0; }
+};
+
+class PolynomialFunction : public Function {
+private:
+    std::vector<double> coefficients;
+public:
+    PolynomialFunction(std::vector<double> coeffs) : coefficients(coeffs) {}
+
+    double evaluate(double x) override {
+        double result = 0;
+        for (int i = 0; i < coefficients.size(); ++i) {
+            result += coefficients[i] * std::pow(x, i);
+        }
+        return result;
+    }
+
+    std::string getFormula() override {
+        return "Polynomial Function";
+    }
+
+    double estimateCost() const override {
+        return static_cast<double>(coefficients.size());
+    }
+};
+
+class TrigonometricFunction : public Function {
+private:
+    std::string type;
+    double amplitude, frequency, phaseShift;
+public:
+    TrigonometricFunction(std::string type, double amplitude, double frequency, double phaseShift)
+        : type(type), amplitude(amplitude), frequency(frequency), phaseShift(phaseShift) {
+    }
+
+    double evaluate(double x) override {
+        if (type == "sin") {
+            return amplitude * std::sin(frequency * x + phaseShift);
+        }
+        else if (type == "cos") {
+            return amplitude * std::cos(frequency * x + phaseShift);
+        }
+        return 0.0; // Unknown type
+    }
+
+    std::string getFormula() override {
+        return "Trigonometric Function";
+    }
+
+    double estimateCost() const override {
+        return 2.0;
+    }
+};
+
+class ExponentialFunction : public Function {
+private:
+    double base, coefficient;
+public:
+    ExponentialFunction(double coefficient, double base) : coefficient(coefficient), base(base) {}
+
+    double evaluate(double x) override {
+        return coefficient * std::pow(base, x);
+    }
+
+    std::string getFormula() override {
+        return "Exponential Function";
+    }
+
+    double estimateCost() const override {
+        return 2.0;
+    }
+};
+
+// How a graph's curve is drawn; width in pixels.
+struct GraphStyle {
+    sf::Color color = sf::Color::Black;
+    float width = 1.5f;
+
+    bool operator==(const GraphStyle& other) const {
+        return color == other.color && width == other.width;
+    }
+};
+
+class Graph {
+public:
+    // Clean: points match targetRange. Dirty: must be resampled before it
+    // is drawn. Pending: a background regeneration will replace the points.
+    enum class SampleState { Clean, Dirty, Pending };
+
+private:
+    // Sample buffers are immutable once published and shared between
+    // graphs (duplicates, identical function/range pairs). Writers go
+    // through editPoints(), which copies a buffer only if it is shared.
+    std::shared_ptr<const SampleSeries> points;
+    std::shared_ptr<const CompactSeries> compactPoints; // set instead of points while compacted
+    std::shared_ptr<const PagedSeries> pagedPoints;     // set instead of points for on-disk data
+    std::shared_ptr<LiveSeries> livePoints;             // set instead of points for streamed data
+    std::shared_ptr<Function> function;
+    int sampleCount;
+    Range targetRange;
+    SampleState state;
+    bool visible;
+    GraphStyle style;
+    Range xBounds, yBounds; // extent of the points, NaN ignored
+    unsigned revision = 0;  // bumped whenever the samples change
+
+    void updateBounds() {
+        if (livePoints) {
+            Range x(INFINITY, -INFINITY), y(INFINITY, -INFINITY);
+            livePoints->visit([&x, &y](const SeriesChunk& chunk) {
+                Range cx = minMaxKernel(chunk.xs, chunk.count), cy = minMaxKernel(chunk.ys, chunk.count);
+                x = Range(std::min(x.min, cx.min), std::max(x.max, cx.max));
+                y = Range(std::min(y.min, cy.min), std::max(y.max, cy.max));
+            });
+            xBounds = x;
+            yBounds = y;
+            return;
+        }
+        if (pagedPoints) {
+            xBounds = pagedPoints->xBounds();
+            yBounds = pagedPoints->yBounds();
+            return;
+        }
+        if (compactPoints) {
+            xBounds = compactPoints->xBounds();
+            yBounds = compactPoints->yBounds();
+            return;
+        }
+        const SampleSeries& series = *points;
+        if (series.isUniform()) {
+            xBounds = series.empty() ? Range(INFINITY, -INFINITY)
+                : Range(std::min(series.front().x, series.back().x), std::max(series.front().x, series.back().x));
+        }
+        else {
+            xBounds = minMaxKernel(series.xData(), series.size());
+        }
+        yBounds = minMaxKernel(series.yData(), series.size());
+    }
+
+    static const std::shared_ptr<const SampleSeries>& emptySeries() {
+        static const std::shared_ptr<const SampleSeries> empty = std::make_shared<SampleSeries>();
+        return empty;
+    }
+
+public:
+    explicit Graph(std::shared_ptr<Function> func)
+        : points(emptySeries()), function(std::move(func)), sampleCount(100), targetRange(0, 0), state(SampleState::Clean), visible(true),
+          xBounds(INFINITY, -INFINITY), yBounds(INFINITY, -INFINITY) {}
+
+    // Graphs are moved, never copied implicitly; duplicate() makes an
+    // explicit copy that shares the sample buffers.
+    Graph(const Graph&) = delete;
+    Graph& operator=(const Graph&) = delete;
+    Graph(Graph&&) = default;
+    Graph& operator=(Graph&&) = default;
+
+    // O(1): the duplicate shares samples and function with this graph, e.g.
+    // to show the same curve with a different style.
+    Graph duplicate() const {
+        Graph copy(function);
+        copy.points = points;
+        copy.compactPoints = compactPoints;
+        copy.pagedPoints = pagedPoints;
+        copy.livePoints = livePoints;
+        copy.sampleCount = sampleCount;
+        copy.targetRange = targetRange;
+        copy.state = state;
+        copy.visible = visible;
+        copy.style = style;
+        copy.xBounds = xBounds;
+        copy.yBounds = yBounds;
+        return copy;
+    }
+
+    std::string serialize() const {
+        std::ostringstream oss;
+        visitSamples([&oss](const SeriesChunk& chunk) {
+            for (size_t i = 0; i < chunk.count; ++i) {
+                oss << chunk.x(i) << "," << chunk.ys[i] << " "; // Пример формата
+            }
+        });
+        return oss.str();
+    }
+    Graph()
+        : points(emptySeries()), function(nullptr), sampleCount(0), targetRange(0, 0), state(SampleState::Clean), visible(true),
+          xBounds(INFINITY, -INFINITY), yBounds(INFINITY, -INFINITY) {
+    }
+    void deserialize(const std::string& data) {
+        std::istringstream iss(data);
+        std::string point;
+        SampleSeries& series = editPoints();
+        series.clear();
+        while (iss >> point) {
+            double x, y;
+            char comma; // Для разделения значений
+            std::istringstream pointStream(point);
+            pointStream >> x >> comma >> y;
+            series.push_back(x, y);
+        }
+        updateBounds();
+    }
+    // Sweeps shorter than this stay on the calling thread: handing chunks
+    // to workers costs more than evaluating a few thousand points.
+    static const int kParallelThreshold = 16384;
+    static const int kChunkSize = 4096;
+
+    void generatePoints(Range xRange, int numPoints, TaskScheduler& scheduler = TaskScheduler::instance()) {
+        SampleSeries sampled;
+        samplePoints(xRange, numPoints, sampled, scheduler);
+        setPoints(sampled);
+        sampleCount = numPoints;
+        targetRange = xRange;
+    }
+
+    // Evaluates the function into `out` without touching the graph's own
+    // points, so several graphs can be sampled first and published together.
+    void samplePoints(Range xRange, int numPoints, SampleSeries& out,
+        TaskScheduler& scheduler = TaskScheduler::instance()) const {
+        sampleFunction(function.get(), xRange, numPoints, out, CancellationToken(), scheduler);
+    }
+
+    // Returns false if the token was cancelled; `out` is then incomplete.
+    // Cancellation is checked at chunk boundaries.
+    static bool sampleFunction(Function* func, Range xRange, int numPoints, SampleSeries& out,
+        const CancellationToken& token, TaskScheduler& scheduler = TaskScheduler::instance()) {
+        double step = (xRange.max - xRange.min) / numPoints;
+        int total = numPoints + 1;
+        out.assignUniform(xRange.min, step, total);
+
+        // Every x is computed from its index, exactly as SampleSeries::x()
+        // derives it, so the result does not depend on how chunks are split
+        // between threads.
+        double* ys = out.yData();
+        auto sampleChunk = [func, ys, xRange, step, &token](int first, int last) {
+            if (token.isCancelled()) {
+                return;
+            }
+            for (int i = first; i < last; ++i) {
+                ys[i] = func->evaluate(xRange.min + i * step);
+            }
+        };
+
+        // On large pages a task fills whole 2 MB pages, so each page is
+        // first touched, and placed, on the node of the worker using it.
+        int grain = out.usesLargePages() ? static_cast<int>(LargePages::kPageBytes / sizeof(double)) : kChunkSize;
+        if (total < kParallelThreshold) {
+            sampleChunk(0, total);
+        }
+        else {
+            parallelFor(0, total, grain, sampleChunk, scheduler);
+        }
+        return !token.isCancelled();
+    }
+
+    const std::shared_ptr<Function>& getFunction() const {
+        return function;
+    }
+
+    void setPoints(SampleSeries& newPoints) {
+        std::shared_ptr<SampleSeries> series = std::make_shared<SampleSeries>();
+        series->swap(newPoints);
+        setPoints(std::move(series));
+    }
+
+    // Publishes an already shared buffer, e.g. one sampled for several graphs.
+    void setPoints(std::shared_ptr<const SampleSeries> series) {
+        points = std::move(series);
+        compactPoints.reset();
+        pagedPoints.reset();
+        livePoints.reset();
+        updateBounds();
+        ++revision;
+        state = SampleState::Clean;
+    }
+
+    // Samples stay on disk and are read page by page while drawing.
+    void setPagedPoints(std::shared_ptr<const PagedSeries> series) {
+        pagedPoints = std::move(series);
+        points = emptySeries();
+        compactPoints.reset();
+        updateBounds();
+        ++revision;
+        state = SampleState::Clean;
+    }
+
+    bool isPaged() const {
+        return pagedPoints != nullptr;
+    }
+
+    // Samples come from a producer thread; the graph shows the latest
+    // window and advances on every pullLive().
+    void setLivePoints(std::shared_ptr<LiveSeries> series) {
+        livePoints = std::move(series);
+        points = emptySeries();
+        compactPoints.reset();
+        pagedPoints.reset();
+        updateBounds();
+        ++revision;
+        state = SampleState::Clean;
+    }
+
+    bool isLive() const {
+        return livePoints != nullptr;
+    }
+
+    // Moves newly produced samples into the window. Render thread only;
+    // returns true if the graph changed.
+    bool pullLive() {
+        if (!livePoints || livePoints->drain() == 0) {
+            return false;
+        }
+        updateBounds();
+        ++revision;
+        return true;
+    }
+
+    std::shared_ptr<const LiveSeries> getLiveSeries() const {
+        return livePoints;
+    }
+
+    // Copy-on-write access: clones the samples first if another graph or a
+    // snapshot still references them. Compacted samples are decoded and
+    // paged samples are read into memory.
+    SampleSeries& editPoints() {
+        expand();
+        if (pagedPoints || livePoints) {
+            // Detaches a live graph from its stream at the current window
+            std::shared_ptr<SampleSeries> loaded = std::make_shared<SampleSeries>();
+            visitSamples([&loaded](const SeriesChunk& chunk) {
+                for (size_t i = 0; i < chunk.count; ++i) {
+                    loaded->push_back(chunk.xs[i], chunk.ys[i]);
+                }
+            });
+            points = loaded;
+            pagedPoints.reset();
+            livePoints.reset();
+        }
+        std::shared_ptr<SampleSeries> own = points.use_count() > 1 || points == emptySeries()
+            ? std::make_shared<SampleSeries>(*points)
+            : std::const_pointer_cast<SampleSeries>(points);
+        points = own;
+        ++revision;
+        state = SampleState::Clean;
+        return *own;
+    }
+
+    // O(1) immutable snapshot of the current samples (empty while compacted
+    // or paged).
+    std::shared_ptr<const SampleSeries> getSharedPoints() const {
+        return compactPoints || pagedPoints || livePoints ? emptySeries() : points;
+    }
+
+    // True if another graph or snapshot shares this graph's sample buffer.
+    bool sharesSamples() const {
+        if (livePoints) {
+            return livePoints.use_count() > 1;
+        }
+        if (pagedPoints) {
+            return pagedPoints.use_count() > 1;
+        }
+        return compactPoints ? compactPoints.use_count() > 1 : points.use_count() > 1 && points != emptySeries();
+    }
+
+    // Marks the points stale without evaluating anything; they are resampled
+    // over xRange the next time the graph is needed on screen.
+    void invalidate(Range xRange) {
+        if (function) {
+            targetRange = xRange;
+            state = SampleState::Dirty;
+        }
+    }
+
+    void markPending(Range xRange) {
+        targetRange = xRange;
+        state = SampleState::Pending;
+    }
+
+    bool needsSampling() const {
+        return state == SampleState::Dirty && visible;
+    }
+
+    SampleState getSampleState() const {
+        return state;
+    }
+
+    Range getTargetRange() const {
+        return targetRange;
+    }
+
+    void setVisible(bool isVisible) {
+        visible = isVisible;
+    }
+
+    bool isVisible() const {
+        return visible;
+    }
+
+    void setStyle(const GraphStyle& newStyle) {
+        style = newStyle;
+    }
+
+    const GraphStyle& getStyle() const {
+        return style;
+    }
+
+    // True if some point falls inside the given window.
+    bool intersects(Range xRange, Range yRange) const {
+        return xBounds.min <= xRange.max && xBounds.max >= xRange.min
+            && yBounds.min <= yRange.max && yBounds.max >= yRange.min;
+    }
+
+    bool isRegenerable() const {
+        return function != nullptr;
+    }
+
+    // Changes whenever the samples do; lets the renderer keep derived data
+    // (vertex arrays) between frames.
+    unsigned getRevision() const {
+        return revision;
+    }
+
+    int getSampleCount() const {
+        return sampleCount;
+    }
+
+    double estimateCost() const {
+        return function ? function->estimateCost() * (sampleCount + 1) : 0.0;
+    }
+
+    // Replaces the samples by their quantized, delta-coded form (lossy: the
+    // error is at most half a quantization step of each 256-sample block).
+    // precisionBits is 16 or 32.
+    void compact(int precisionBits = 16) {
+        if (compactPoints || pagedPoints || livePoints || points->empty()) {
+            return;
+        }
+        std::shared_ptr<CompactSeries> encoded = std::make_shared<CompactSeries>();
+        encoded->encode(*points, precisionBits);
+        compactPoints = std::move(encoded);
+        points = emptySeries();
+        ++revision;
+    }
+
+    // Drops the samples of a function graph to free memory. The graph
+    // becomes dirty and is resampled the next time it is drawn.
+    void evictSamples() {
+        if (!function) {
+            return;
+        }
+        points = emptySeries();
+        compactPoints.reset();
+        updateBounds();
+        ++revision;
+        state = SampleState::Dirty;
+    }
+
+    // Moves in-memory samples into a scratch paged file that is deleted
+    // with the graph's last reference to it. Lossless, unlike compact().
+    bool spill(const std::string& path) {
+        if (pagedPoints || livePoints || getPointCount() == 0 || !PagedSeries::write(path, *this)) {
+            return false;
+        }
+        std::shared_ptr<PagedSeries> series = PagedSeries::open(path);
+        if (!series) {
+            std::remove(path.c_str());
+            return false;
+        }
+        series->setTemporary(true);
+        setPagedPoints(series);
+        return true;
+    }
+
+    // Identifies the sample buffer, so graphs sharing one are counted once.
+    const void* storageId() const {
+        if (livePoints) {
+            return livePoints.get();
+        }
+        if (pagedPoints) {
+            return pagedPoints.get();
+        }
+        return compactPoints ? static_cast<const void*>(compactPoints.get()) : points.get();
+    }
+
+    // Decodes compacted samples back into a SampleSeries.
+    void expand() {
+        if (!compactPoints) {
+            return;
+        }
+        std::shared_ptr<SampleSeries> decoded = std::make_shared<SampleSeries>();
+        compactPoints->decode(*decoded);
+        points = std::move(decoded);
+        compactPoints.reset();
+    }
+
+    bool isCompacted() const {
+        return compactPoints != nullptr;
+    }
+
+    size_t getPointCount() const {
+        if (livePoints) {
+            return livePoints->size();
+        }
+        if (pagedPoints) {
+            return pagedPoints->size();
+        }
+        return compactPoints ? compactPoints->size() : points->size();
+    }
+
+    // Resident memory of the samples; pages of paged data are accounted by
+    // PageCache instead.
+    size_t memoryBytes() const {
+        if (livePoints) {
+            return livePoints->memoryBytes();
+        }
+        if (pagedPoints) {
+            return 0;
+        }
+        return compactPoints ? compactPoints->memoryBytes() : points->memoryBytes();
+    }
+
+    // Starts loading the on-disk pages a view of xWindow will need.
+    void prefetch(Range xWindow) const {
+        if (pagedPoints) {
+            pagedPoints->prefetch(xWindow);
+        }
+    }
+
+    // Calls visitor(const SeriesChunk&) for consecutive runs of samples,
+    // decoding compacted data block by block and reading paged data page by
+    // page on the way. This is how the renderer and serializer read points.
+    // Paged data outside xWindow is skipped; other storage is visited whole.
+    template <typename Visitor>
+    void visitSamples(const Visitor& visitor, Range xWindow = Range(-INFINITY, INFINITY)) const {
+        if (livePoints) {
+            livePoints->visit(visitor);
+        }
+        else if (pagedPoints) {
+            pagedPoints->visit(visitor, xWindow);
+        }
+        else if (compactPoints) {
+            compactPoints->visit(visitor);
+        }
+        else if (!points->empty()) {
+            visitor(points->chunk(0, points->size()));
+        }
+    }
+
+    // visitSamples for drawing: a paged view too wide for the page cache is
+    // visited as its page envelope instead of reading the whole file.
+    template <typename Visitor>
+    void visitVisibleSamples(const Visitor& visitor, Range xWindow) const {
+        if (pagedPoints && pagedPoints->exceedsCache(xWindow)) {
+            pagedPoints->visitEnvelope(visitor, xWindow);
+        }
+        else {
+            visitSamples(visitor, xWindow);
+        }
+    }
+
+    // Raw samples; empty while the graph is compacted (use visitSamples).
+    const SampleSeries& getPoints() const {
+        return *points;
+    }
+};
+
+class CoordinateSystem {
+private:
+    Range xRange;
+    Range yRange;
+
+public:
+    CoordinateSystem(Range x, Range y) : xRange(x), yRange(y) {}
+
+    void setRanges(Range newXRange, Range newYRange) {
+        xRange = newXRange;
+        yRange = newYRange;
+    }
+
+    Range getXRange() const { return xRange; }
+    Range getYRange() const { return yRange; }
+};
+
+// Stable reference to a graph owned by PlotArea. It stays valid when other
+// graphs are added, removed or reordered; id 0 is never issued.
+struct GraphHandle {
+    unsigned id = 0;
+
+    bool isValid() const { return id != 0; }
+    bool operator==(const GraphHandle& other) const { return id == other.id; }
+    bool operator!=(const GraphHandle& other) const { return id != other.id; }
+};
+
+// Process-wide limit on sample memory: graph samples, the page cache and
+// the renderer's curve caches. Also says where spilled samples go.
+class MemoryBudget {
+private:
+    std::atomic<size_t> budget;
+    std::atomic<size_t> cacheBytes; // registered by caches outside PlotArea
+    mutable std::mutex mutex;
+    std::string spillDirectory;     // empty: the system temporary directory
+
+    MemoryBudget() : budget(512u << 20), cacheBytes(0) {}
+
+public:
+    static MemoryBudget& instance() {
+        static MemoryBudget memoryBudget;
+        return memoryBudget;
+    }
+
+    void setBudget(size_t bytes) {
+        budget = bytes;
+    }
+
+    size_t getBudget() const {
+        return budget;
+    }
+
+    // Caches the budget cannot free itself (curve geometry) register their
+    // size, so that it is counted and other memory is freed instead.
+    void addCacheBytes(size_t bytes) {
+        cacheBytes += bytes;
+    }
+
+    void removeCacheBytes(size_t bytes) {
+        cacheBytes -= bytes;
+    }
+
+    size_t getCacheBytes() const {
+        return cacheBytes;
+    }
+
+    void setSpillDirectory(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        spillDirectory = path;
+    }
+
+    // Directory for spill files, with a trailing separator.
+    std::string getSpillDirectory() const {
+        std::string directory;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            directory = spillDirectory;
+        }
+        if (directory.empty()) {
+#ifdef _WIN32
+            char buffer[MAX_PATH + 1];
+            DWORD length = GetTempPathA(sizeof(buffer), buffer);
+            directory = length > 0 && length < sizeof(buffer) ? std::string(buffer, length) : ".";
+#else
+            const char* temporary = std::getenv("TMPDIR");
+            directory = temporary && *temporary ? temporary : "/tmp";
+#endif
+        }
+        char last = directory.back();
+        if (last != '/' && last != '\\') {
+            directory += '/';
+        }
+        return directory;
+    }
+};
+
+class PlotArea {
+public:
+    struct GraphSlot {
+        GraphHandle handle;
+        std::unique_ptr<Graph> graph;
+    };
+
+private:
+    CoordinateSystem coordinateSystem;
+    std::vector<GraphSlot> graphs; // in drawing order
+    unsigned nextHandleId = 1;
+
+    // One graph to resample. The function is shared, so background work
+    // keeps it alive even if the graph is removed meanwhile. Graphs showing
+    // the same function over the same range share one buffer.
+    struct SamplingJob {
+        GraphHandle handle;
+        std::shared_ptr<Function> function;
+        int sampleCount;
+        Range xRange;
+        double cost;
+        size_t buffer; // index of the sample buffer this job reads
+        bool owner;    // the first job of a buffer samples it
+    };
+
+    // Result of the newest background regeneration, waiting for update().
+    struct PendingFrame {
+        std::mutex mutex;
+        bool ready = false;
+        unsigned generation = 0;
+        std::vector<SamplingJob> jobs;
+        std::vector<SampleSeries> points;
+    };
+
+    std::shared_ptr<std::atomic<unsigned>> generation;
+    std::shared_ptr<PendingFrame> pending;
+    Range pendingRange, pendingYRange; // published with the pending samples
+    bool overBudgetReported = false;   // warn once each time usage stays over the budget
+    TaskGroup background;
+
+    // Hidden graphs are never sampled here; they stay dirty until shown.
+    std::vector<SamplingJob> collectJobs(Graph::SampleState state) const {
+        std::vector<SamplingJob> jobs;
+        for (const auto& slot : graphs) {
+            const Graph& graph = *slot.graph;
+            if (graph.isRegenerable() && graph.isVisible() && graph.getSampleState() == state) {
+                jobs.push_back({ slot.handle, graph.getFunction(), graph.getSampleCount(),
+                    graph.getTargetRange(), graph.estimateCost(), 0, true });
+            }
+        }
+        // The most expensive graphs go first so cheap ones fill the gaps at the end
+        std::sort(jobs.begin(), jobs.end(), [](const SamplingJob& a, const SamplingJob& b) {
+            return a.cost > b.cost;
+        });
+        size_t buffers = 0;
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            jobs[i].buffer = buffers;
+            jobs[i].owner = true;
+            for (size_t j = 0; j < i; ++j) {
+                if (jobs[j].owner && jobs[j].function == jobs[i].function && jobs[j].sampleCount == jobs[i].sampleCount
+                    && jobs[j].xRange.min == jobs[i].xRange.min && jobs[j].xRange.max == jobs[i].xRange.max) {
+                    jobs[i].buffer = jobs[j].buffer;
+                    jobs[i].owner = false;
+                    break;
+                }
+            }
+            if (jobs[i].owner) {
+                ++buffers;
+            }
+        }
+        return jobs;
+    }
+
+    static bool sampleJobs(const std::vector<SamplingJob>& jobs,
+        std::vector<SampleSeries>& sampled, const CancellationToken& token) {
+        size_t buffers = jobs.empty() ? 0 : 1;
+        for (const auto& job : jobs) {
+            buffers = std::max(buffers, job.buffer + 1);
+        }
+        sampled.assign(buffers, SampleSeries());
+        TaskGroup group;
+        for (const auto& job : jobs) {
+            if (!job.owner) {
+                continue;
+            }
+            const SamplingJob* owner = &job;
+            group.run([owner, &sampled, &token]() {
+                Graph::sampleFunction(owner->function.get(), owner->xRange, owner->sampleCount,
+                    sampled[owner->buffer], token);
+            });
+        }
+        group.wait();
+        return !token.isCancelled();
+    }
+
+    void publish(const std::vector<SamplingJob>& jobs, std::vector<SampleSeries>& sampled) {
+        std::vector<std::shared_ptr<const SampleSeries>> shared(sampled.size());
+        for (size_t i = 0; i < sampled.size(); ++i) {
+            std::shared_ptr<SampleSeries> series = std::make_shared<SampleSeries>();
+            series->swap(sampled[i]);
+            shared[i] = std::move(series);
+        }
+        for (const auto& job : jobs) {
+            if (Graph* graph = getGraph(job.handle)) {
+                graph->setPoints(shared[job.buffer]);
+            }
+        }
+    }
+
+    size_t findSlot(GraphHandle handle) const {
+        for (size_t i = 0; i < graphs.size(); ++i) {
+            if (graphs[i].handle == handle) {
+                return i;
+            }
+        }
+        return graphs.size();
+    }
+
+    CancellationToken nextGeneration() {
+        return CancellationToken(generation, ++*generation);
+    }
+
+    // Bytes of graph samples, each shared buffer counted once.
+    size_t sampleBytes() const {
+        std::vector<const void*> seen;
+        size_t total = 0;
+        for (const auto& slot : graphs) {
+            const void* id = slot.graph->storageId();
+            if (std::find(seen.begin(), seen.end(), id) == seen.end()) {
+                seen.push_back(id);
+                total += slot.graph->memoryBytes();
+            }
+        }
+        return total;
+    }
+
+    // Unique across processes sharing the directory: process id, time and
+    // a per-process counter.
+    static std::string spillFilename() {
+        static std::atomic<unsigned> counter(0);
+        long long stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+#ifdef _WIN32
+        unsigned long process = GetCurrentProcessId();
+#else
+        unsigned long process = static_cast<unsigned long>(getpid());
+#endif
+        return MemoryBudget::instance().getSpillDirectory() + "plot_spill_" + std::to_string(process) + "_"
+            + std::to_string(stamp) + "_" + std::to_string(++counter) + ".trace";
+    }
+
+public:
+    PlotArea(CoordinateSystem cs)
+        : coordinateSystem(cs), generation(std::make_shared<std::atomic<unsigned>>(0)),
+          pending(std::make_shared<PendingFrame>()), pendingRange(cs.getXRange()), pendingYRange(cs.getYRange()) {}
+
+    // Adds an O(1) copy of an existing graph that shares its samples until
+    // one of them is modified.
+    GraphHandle duplicateGraph(GraphHandle handle) {
+        const Graph* graph = getGraph(handle);
+        return graph ? addGraph(graph->duplicate()) : GraphHandle();
+    }
+
+    // Takes ownership of the graph; its samples are moved, not copied.
+    GraphHandle addGraph(Graph&& graph) {
+        GraphSlot slot;
+        slot.handle.id = nextHandleId++;
+        slot.graph.reset(new Graph(std::move(graph)));
+        graphs.push_back(std::move(slot));
+        return graphs.back().handle;
+    }
+
+    // Adds a graph whose samples stay in a paged file on disk; returns an
+    // invalid handle if the file cannot be opened.
+    GraphHandle addPagedGraph(const std::string& filename) {
+        std::shared_ptr<PagedSeries> series = PagedSeries::open(filename);
+        if (!series) {
+            return GraphHandle();
+        }
+        Graph graph;
+        graph.setPagedPoints(series);
+        return addGraph(std::move(graph));
+    }
+
+    // Adds a graph that shows the latest window of a live stream.
+    GraphHandle addLiveGraph(std::shared_ptr<LiveSeries> series) {
+        Graph graph;
+        graph.setLivePoints(std::move(series));
+        return addGraph(std::move(graph));
+    }
+
+    void removeGraph(GraphHandle handle) {
+        size_t index = findSlot(handle);
+        if (index < graphs.size()) {
+            graphs.erase(graphs.begin() + index);
+        }
+    }
+
+    // Moves a graph to the given drawing position; only the owning pointer moves.
+    void moveGraph(GraphHandle handle, size_t position) {
+        size_t index = findSlot(handle);
+        if (index == graphs.size()) {
+            return;
+        }
+        GraphSlot slot = std::move(graphs[index]);
+        graphs.erase(graphs.begin() + index);
+        position = std::min(position, graphs.size());
+        graphs.insert(graphs.begin() + position, std::move(slot));
+    }
+
+    // nullptr if the graph was removed.
+    Graph* getGraph(GraphHandle handle) {
+        size_t index = findSlot(handle);
+        return index < graphs.size() ? graphs[index].graph.get() : nullptr;
+    }
+
+    const Graph* getGraph(GraphHandle handle) const {
+        size_t index = findSlot(handle);
+        return index < graphs.size() ? graphs[index].graph.get() : nullptr;
+    }
+
+    void clear() {
+        cancelPending();
+        graphs.clear();
+    }
+
+    const std::vector<GraphSlot>& getGraphs() const {
+        return graphs;
+    }
+
+    const CoordinateSystem& getCoordinateSystem() const {
+        return coordinateSystem;
+    }
+
+    void setGraphVisible(GraphHandle handle, bool visible) {
+        if (Graph* graph = getGraph(handle)) {
+            graph->setVisible(visible);
+        }
+    }
+
+    void setGraphStyle(GraphHandle handle, const GraphStyle& style) {
+        if (Graph* graph = getGraph(handle)) {
+            graph->setStyle(style);
+        }
+    }
+
+    // Keeps an archived or background graph in compressed form; it is still
+    // drawn and saved, decoding block by block.
+    void compactGraph(GraphHandle handle, int precisionBits = 16) {
+        if (Graph* graph = getGraph(handle)) {
+            graph->compact(precisionBits);
+        }
+    }
+
+    // Changes the ranges and marks every function graph stale. Nothing is
+    // evaluated until materializeVisible() runs for the next frame.
+    void invalidate(Range xRange, Range yRange) {
+        nextGeneration();
+        for (auto& slot : graphs) {
+            slot.graph->invalidate(xRange);
+        }
+        coordinateSystem.setRanges(xRange, yRange);
+    }
+
+    // Samples the stale graphs that are visible, concurrently, and publishes
+    // them together. Called by the renderer before drawing.
+    void materializeVisible() {
+        std::vector<SamplingJob> jobs = collectJobs(Graph::SampleState::Dirty);
+        if (jobs.empty()) {
+            return;
+        }
+        std::vector<SampleSeries> sampled;
+        sampleJobs(jobs, sampled, CancellationToken());
+        publish(jobs, sampled);
+    }
+
+    // Resamples every visible function graph over xRange right away. New
+    // points are published only after all graphs are done, so a frame never
+    // mixes old and new ranges. Loaded graphs are kept.
+    void regenerate(Range xRange, Range yRange) {
+        invalidate(xRange, yRange);
+        materializeVisible();
+    }
+
+    // Same as regenerate(), but returns immediately. The current points stay
+    // on screen until update() publishes the new ones. A newer request (or
+    // clear()) cancels work still in flight at the next chunk boundary.
+    // Hidden graphs are only marked dirty. The new ranges are published
+    // together with the points, or right away if nothing needs sampling.
+    void regenerateAsync(Range xRange, Range yRange) {
+        CancellationToken token = nextGeneration();
+        unsigned requested = generation->load();
+        for (auto& slot : graphs) {
+            slot.graph->invalidate(xRange);
+        }
+        std::vector<SamplingJob> jobs = collectJobs(Graph::SampleState::Dirty);
+        for (const auto& job : jobs) {
+            getGraph(job.handle)->markPending(xRange);
+        }
+        pendingRange = xRange;
+        pendingYRange = yRange;
+        if (jobs.empty()) {
+            coordinateSystem.setRanges(xRange, yRange);
+            return;
+        }
+        std::shared_ptr<PendingFrame> frame = pending;
+        background.run([jobs, token, requested, frame]() {
+            std::vector<SampleSeries> sampled;
+            if (!sampleJobs(jobs, sampled, token)) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(frame->mutex);
+            // A newer request may have finished first; never replace its result
+            if (token.isCancelled() || requested <= frame->generation) {
+                return;
+            }
+            frame->ready = true;
+            frame->generation = requested;
+            frame->jobs = jobs;
+            frame->points.swap(sampled);
+        });
+    }
+
+    // Cancels background regeneration; work in flight stops at its next
+    // chunk boundary and its result is discarded. The graphs it was for go
+    // back to dirty over the range on screen, so the next frame resamples
+    // them instead of leaving them pending forever.
+    void cancelPending() {
+        ++*generation;
+        for (auto& slot : graphs) {
+            if (slot.graph->getSampleState() == Graph::SampleState::Pending) {
+                slot.graph->invalidate(coordinateSystem.getXRange());
+            }
+        }
+    }
+
+    // Publishes a finished background regeneration and pulls new samples
+    // into live graphs. Call once per frame; returns true if the graphs
+    // changed.
+    bool update() {
+        bool changed = false;
+        for (auto& slot : graphs) {
+            changed |= slot.graph->pullLive();
+        }
+        std::lock_guard<std::mutex> lock(pending->mutex);
+        if (!pending->ready) {
+            return changed;
+        }
+        pending->ready = false;
+        if (pending->generation != generation->load()) {
+            return changed; // stale result
+        }
+        publish(pending->jobs, pending->points);
+        coordinateSystem.setRanges(pendingRange, pendingYRange);
+        return true;
+    }
+
+    size_t memoryUsage() const {
+        return sampleBytes() + PageCache::instance().getUsage() + MemoryBudget::instance().getCacheBytes();
+    }
+
+    // Frees memory until usage fits MemoryBudget, cheapest to restore first:
+    //  1. cached pages nobody is reading;
+    //  2. samples of hidden function graphs, cheapest to resample per byte
+    //     first (they become dirty);
+    //  3. full-precision samples of visible function graphs, which are
+    //     compacted (they are still drawn, and an exact copy is one
+    //     resample away);
+    //  4. loaded graphs, largest first, spilled losslessly to scratch files
+    //     in MemoryBudget's spill directory.
+    // Curve caches are counted but not freed here; they hold only what is
+    // drawn.
+    // Lossy compaction of visible graphs is reported. Called every frame;
+    // running over a budget that cannot be met is reported once until
+    // usage fits again. Returns the number of bytes freed.
+    size_t enforceMemoryBudget() {
+        size_t budget = MemoryBudget::instance().getBudget();
+        size_t usage = memoryUsage();
+        size_t initial = usage;
+        if (usage <= budget) {
+            overBudgetReported = false;
+            return 0;
+        }
+        usage -= PageCache::instance().trim(usage - budget);
+
+        std::vector<Graph*> hidden, visible, loaded;
+        for (auto& slot : graphs) {
+            Graph* graph = slot.graph.get();
+            if (graph->memoryBytes() == 0 || graph->sharesSamples()) {
+                continue; // nothing to free, or freeing it would not release the buffer
+            }
+            if (!graph->isRegenerable()) {
+                loaded.push_back(graph);
+            }
+            else if (graph->isVisible()) {
+                visible.push_back(graph);
+            }
+            else {
+                hidden.push_back(graph);
+            }
+        }
+        std::sort(hidden.begin(), hidden.end(), [](const Graph* a, const Graph* b) {
+            return a->estimateCost() / a->memoryBytes() < b->estimateCost() / b->memoryBytes();
+        });
+        auto bySize = [](const Graph* a, const Graph* b) { return a->memoryBytes() > b->memoryBytes(); };
+        std::sort(visible.begin(), visible.end(), bySize);
+        std::sort(loaded.begin(), loaded.end(), bySize);
+
+        for (Graph* graph : hidden) {
+            if (usage <= budget) {
+                break;
+            }
+            usage -= graph->memoryBytes();
+            graph->evictSamples();
+        }
+        int compacted = 0;
+        for (Graph* graph : visible) {
+            if (usage <= budget) {
+                break;
+            }
+            if (graph->isCompacted()) {
+                continue;
+            }
+            size_t before = graph->memoryBytes();
+            graph->compact();
+            usage -= before - graph->memoryBytes();
+            ++compacted;
+        }
+        if (compacted > 0) {
+            std::cerr << "Memory budget: " << compacted << " visible graph(s) compacted, drawn at reduced precision" << std::endl;
+        }
+        for (Graph* graph : loaded) {
+            if (usage <= budget) {
+                break;
+            }
+            size_t before = graph->memoryBytes();
+            if (graph->spill(spillFilename())) {
+                usage -= before;
+            }
+        }
+        usage = memoryUsage();
+        if (usage <= budget) {
+            overBudgetReported = false;
+        }
+        else if (!overBudgetReported) {
+            std::cerr << "Memory budget exceeded: " << usage << " of " << budget << " bytes in use" << std::endl;
+            overBudgetReported = true;
+        }
+        return initial > usage ? initial - usage : 0;
+    }
+
+    // Prints the memory held by each graph and the totals against the budget.
+    void reportMemory(std::ostream& out) const {
+        for (size_t i = 0; i < graphs.size(); ++i) {
+            const Graph& graph = *graphs[i].graph;
+            const char* storage = graph.isPaged() ? "на диске"
+                : graph.isCompacted() ? "сжат" : graph.getPointCount() == 0 ? "выгружен" : "в памяти";
+            out << "  график " << graphs[i].handle.id << ": " << graph.getPointCount() << " точек, "
+                << graph.memoryBytes() << " байт (" << storage << (graph.sharesSamples() ? ", общий" : "") << ")\n";
+        }
+        out << "  точки: " << sampleBytes() << " байт, кэш страниц: " << PageCache::instance().getUsage()
+            << " байт, кэш кривых: " << MemoryBudget::instance().getCacheBytes() << " байт, всего " << memoryUsage() << " из " << MemoryBudget::instance().getBudget() << " байт\n";
+        if (LargePages::isEnabled() || LargePages::getBytesInUse() > 0) {
+            out << "  на страницах по 2 МБ: " << LargePages::getBytesInUse() << " байт\n";
+        }
+    }
+
+    void saveToFile(const std::string& filename) {
+        std::ofstream outFile(filename);
+        for (const auto& slot : graphs) {
+            outFile << slot.graph->serialize() << std::endl; // Сохраняем каждый график
+        }
+        outFile.close();
+    }
+    void loadFromFile(const std::string& filename) {
+        std::ifstream inFile(filename);
+        std::string line;
+        std::vector<std::string> lines;
+        clear(); // Очищаем текущие графики перед загрузкой
+        while (std::getline(inFile, line)) {
+            lines.push_back(line);
+        }
+        inFile.close();
+
+        // Каждая строка - отдельный график, разбираем их параллельно
+        std::vector<Graph> loaded(lines.size());
+        parallelFor(0, static_cast<int>(lines.size()), 1, [&](int first, int last) {
+            for (int i = first; i < last; ++i) {
+                loaded[i].deserialize(lines[i]);
+            }
+        });
+        for (auto& graph : loaded) {
+            addGraph(std::move(graph));
+        }
+    }
+};
+
+// Bump allocator for data that lives for one frame. allocate() only moves
+// an offset; reset() at the end of the frame releases everything at once.
+// When a frame outgrows the arena, extra blocks are taken from the heap and
+// merged into a single block on reset, so the steady state allocates
+// nothing from the heap.
+class FrameArena {
+public:
+    struct Stats {
+        size_t allocations = 0;     // allocate() calls
+        size_t bytes = 0;           // bytes handed out
+        size_t heapAllocations = 0; // blocks taken from the heap
+    };
+
+private:
+    std::vector<AlignedArray<unsigned char>> blocks;
+    size_t offset = 0; // into blocks.back()
+    Stats current, lastFrame;
+
+    void grow(size_t minimum) {
+        size_t size = std::max<size_t>(minimum, blocks.empty() ? 64 * 1024 : blocks.back().size() * 2);
+        blocks.emplace_back();
+        blocks.back().resize(size);
+        offset = 0;
+        ++current.heapAllocations;
+    }
+
+public:
+    void* allocate(size_t bytes, size_t alignment = 64) {
+        size_t start = (offset + alignment - 1) & ~(alignment - 1);
+        if (blocks.empty() || start + bytes > blocks.back().size()) {
+            grow(bytes + alignment);
+            start = 0;
+        }
+        offset = start + bytes;
+        ++current.allocations;
+        current.bytes += bytes;
+        return blocks.back().data() + start;
+    }
+
+    // Uninitialized storage for n objects of a trivially destructible type.
+    template <typename T>
+    T* allocateArray(size_t n) {
+        return static_cast<T*>(allocate(n * sizeof(T), std::max<size_t>(alignof(T), 64)));
+    }
+
+    // Ends the frame. Its statistics become the last frame's only if it was
+    // drawn; a skipped frame would otherwise report an empty frame.
+    void reset(bool drawn = true) {
+        if (blocks.size() > 1) {
+            size_t total = 0;
+            for (const auto& block : blocks) {
+                total += block.size();
+            }
+            blocks.clear();
+            grow(total);
+        }
+        offset = 0;
+        if (drawn) {
+            lastFrame = current;
+        }
+        current = Stats();
+    }
+
+    const Stats& getLastFrameStats() const {
+        return lastFrame;
+    }
+};
+
+// Loads fonts once per process and hands out shared references. A font can
+// be requested early with preloadFont(), which parses the file on a
+// background thread while the window opens; getFont() never blocks the
+// frame and returns nullptr until the font is ready.
+class ResourceManager {
+private:
+    enum class Status { Loading, Ready, Failed };
+
+    struct FontEntry {
+        std::mutex mutex;
+        std::condition_variable loaded;
+        Status status = Status::Loading;
+        std::shared_ptr<sf::Font> font;
+        bool prewarmed = false; // touched by the render thread only
+    };
+
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<FontEntry>> fonts;
+
+    static void load(const std::string& filename, FontEntry& entry) {
+        std::shared_ptr<sf::Font> font = std::make_shared<sf::Font>();
+        bool ok = font->loadFromFile(filename);
+        if (!ok) {
+            std::cerr << "Error loading font " << filename << "!" << std::endl;
+        }
+        std::lock_guard<std::mutex> lock(entry.mutex);
+        entry.font = ok ? std::move(font) : nullptr;
+        entry.status = ok ? Status::Ready : Status::Failed;
+        entry.loaded.notify_all();
+    }
+
+    // Creates the entry on first request; async decides where it loads.
+    std::shared_ptr<FontEntry> findOrLoad(const std::string& filename, bool async) {
+        std::shared_ptr<FontEntry> entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::shared_ptr<FontEntry>& slot = fonts[filename];
+            if (slot) {
+                return slot;
+            }
+            slot = std::make_shared<FontEntry>();
+            entry = slot;
+        }
+        if (async) {
+            std::thread([filename, entry]() { load(filename, *entry); }).detach();
+        }
+        else {
+            load(filename, *entry);
+        }
+        return entry;
+    }
+
+public:
+    static ResourceManager& instance() {
+        static ResourceManager manager;
+        return manager;
+    }
+
+    // Starts loading in the background; later calls are no-ops.
+    void preloadFont(const std::string& filename) {
+        findOrLoad(filename, true);
+    }
+
+    // True while a background load of the font has not finished either way.
+    bool isLoading(const std::string& filename) {
+        std::shared_ptr<FontEntry> entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = fonts.find(filename);
+            if (found == fonts.end()) {
+                return false;
+            }
+            entry = found->second;
+        }
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        return entry->status == Status::Loading;
+    }
+
+    // The font if it is loaded, nullptr while it is still loading or if it
+    // failed. Loads synchronously if nobody asked for it before; with wait,
+    // also waits for a background load to finish.
+    std::shared_ptr<const sf::Font> getFont(const std::string& filename, bool wait = false) {
+        std::shared_ptr<FontEntry> entry = findOrLoad(filename, false);
+        std::unique_lock<std::mutex> lock(entry->mutex);
+        if (wait) {
+            entry->loaded.wait(lock, [&entry]() { return entry->status != Status::Loading; });
+        }
+        if (entry->status != Status::Ready) {
+            return nullptr;
+        }
+        // Rasterize the glyphs every frame uses into the atlas up front, so
+        // the first frames do not stall on them. Needs the render thread's
+        // GL context, hence here rather than in the loader.
+        if (!entry->prewarmed) {
+            static const char kCommonGlyphs[] = "0123456789-+.,eXY";
+            static const unsigned kSizes[] = { 15, 20 };
+            for (unsigned size : kSizes) {
+                for (const char* c = kCommonGlyphs; *c; ++c) {
+                    entry->font->getGlyph(static_cast<sf::Uint32>(*c), size, false);
+                }
+            }
+            entry->prewarmed = true;
+        }
+        return entry->font;
+    }
+};
+
+// Screen rectangles that must be repainted. Overlapping rectangles are
+// merged; past a handful they collapse into their bounding box, since many
+// small repaints cost more than one larger one.
+class DamageRegion {
+private:
+    static const size_t kMaxRects = 8;
+    std::vector<sf::FloatRect> rects;
+    bool full = false;
+
+    static sf::FloatRect merge(const sf::FloatRect& a, const sf::FloatRect& b) {
+        float left = std::min(a.left, b.left), top = std::min(a.top, b.top);
+        float right = std::max(a.left + a.width, b.left + b.width);
+        float bottom = std::max(a.top + a.height, b.top + b.height);
+        return sf::FloatRect(left, top, right - left, bottom - top);
+    }
+
+public:
+    void add(sf::FloatRect rect) {
+        if (full || rect.width <= 0 || rect.height <= 0) {
+            return;
+        }
+        // Absorb every rectangle the new one overlaps; merging can make it
+        // overlap others, so repeat until nothing changes
+        bool merged = true;
+        while (merged) {
+            merged = false;
+            for (size_t i = 0; i < rects.size(); ++i) {
+                if (rects[i].intersects(rect)) {
+                    rect = merge(rects[i], rect);
+                    rects.erase(rects.begin() + i);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+        rects.push_back(rect);
+        if (rects.size() > kMaxRects) {
+            sf::FloatRect all = rects[0];
+            for (const auto& r : rects) {
+                all = merge(all, r);
+            }
+            rects.assign(1, all);
+        }
+    }
+
+    void addAll() {
+        full = true;
+        rects.clear();
+    }
+
+    bool empty() const { return !full && rects.empty(); }
+    bool isFull() const { return full; }
+    const std::vector<sf::FloatRect>& getRects() const { return rects; }
+
+    void clear() {
+        full = false;
+        rects.clear();
+    }
+};
+
+const size_t DamageRegion::kMaxRects;
+
+// Clips a polyline to a rectangle in double precision, before anything is
+// converted to float. Points get Cohen–Sutherland outcodes a chunk at a
+// time (a branch-free loop the compiler vectorizes); segments whose ends
+// share an outside bit are dropped, segments inside on both ends pass
+// untouched, and only the rest go through Liang–Barsky. NaN and infinite
+// samples break the line. The visible pieces go to a sink:
+// sink.begin() starts a new run, sink.vertex(x, y) extends it.
+class PolylineClipper {
+private:
+    enum : unsigned char { kLeft = 1, kRight = 2, kBelow = 4, kAbove = 8, kInvalid = 16 };
+
+    double xMin, xMax, yMin, yMax;
+    bool hasPrevious = false;
+    bool open = false; // the previous point ended the current run
+    double previousX = 0, previousY = 0;
+    unsigned char previousCode = 0;
+
+    // Liang–Barsky: narrows [t0, t1] to the part of p0 + t*d inside one
+    // edge, p*t <= q, and remembers which edge cut each end. False if
+    // nothing is left.
+    static bool clipEdge(double p, double q, int edge, double& t0, double& t1, int& edge0, int& edge1) {
+        if (p == 0) {
+            return q >= 0;
+        }
+        double t = q / p;
+        if (p < 0) {
+            if (t > t1) return false;
+            if (t > t0) { t0 = t; edge0 = edge; }
+        }
+        else {
+            if (t < t0) return false;
+            if (t < t1) { t1 = t; edge1 = edge; }
+        }
+        return true;
+    }
+
+    // Point at t, placed exactly on the edge that cut it: interpolating
+    // between huge coordinates cancels catastrophically, so the edge
+    // coordinate is taken as is and the other one clamped to the box.
+    void pointAt(double x0, double y0, double dx, double dy, double t, int edge, double& x, double& y) const {
+        x = std::min(std::max(x0 + t * dx, xMin), xMax);
+        y = std::min(std::max(y0 + t * dy, yMin), yMax);
+        switch (edge) {
+        case kLeft: x = xMin; break;
+        case kRight: x = xMax; break;
+        case kBelow: y = yMin; break;
+        case kAbove: y = yMax; break;
+        }
+    }
+
+    template <typename Sink>
+    void segment(double x1, double y1, unsigned char code1, Sink& sink) {
+        double x0 = previousX, y0 = previousY;
+        unsigned char code0 = previousCode;
+        if ((code0 | code1) == 0) {
+            if (!open) {
+                sink.begin();
+                sink.vertex(x0, y0);
+            }
+            sink.vertex(x1, y1);
+            open = true;
+            return;
+        }
+        if (code0 & code1) {
+            open = false; // both ends beyond the same edge
+            return;
+        }
+        // A segment between huge coordinates of opposite sign can
+        // overflow d; halving it keeps every intermediate finite.
+        double scale = 1, dx = x1 - x0, dy = y1 - y0;
+        if (!std::isfinite(dx) || !std::isfinite(dy)) {
+            scale = 0.5;
+            dx = x1 * 0.5 - x0 * 0.5;
+            dy = y1 * 0.5 - y0 * 0.5;
+        }
+        double t0 = 0, t1 = 1 / scale;
+        int edge0 = 0, edge1 = 0;
+        if (!clipEdge(-dx, x0 - xMin, kLeft, t0, t1, edge0, edge1) || !clipEdge(dx, xMax - x0, kRight, t0, t1, edge0, edge1)
+            || !clipEdge(-dy, y0 - yMin, kBelow, t0, t1, edge0, edge1) || !clipEdge(dy, yMax - y0, kAbove, t0, t1, edge0, edge1)) {
+            open = false;
+            return;
+        }
+        double x, y;
+        if (!open || t0 > 0) {
+            sink.begin();
+            if (code0 == 0) {
+                sink.vertex(x0, y0);
+            }
+            else {
+                pointAt(x0, y0, dx, dy, t0, edge0, x, y);
+                sink.vertex(x, y);
+            }
+        }
+        if (code1 == 0) {
+            sink.vertex(x1, y1);
+        }
+        else {
+            pointAt(x0, y0, dx, dy, t1, edge1, x, y);
+            sink.vertex(x, y);
+        }
+        open = code1 == 0;
+    }
+
+public:
+    PolylineClipper(Range x, Range y) : xMin(x.min), xMax(x.max), yMin(y.min), yMax(y.max) {}
+
+    // Outcodes of n points; a NaN or infinite coordinate gets kInvalid.
+    void outcodes(const double* xs, const double* ys, size_t n, unsigned char* codes) const {
+        for (size_t i = 0; i < n; ++i) {
+            double x = xs[i], y = ys[i];
+            codes[i] = static_cast<unsigned char>((x < xMin) | (x > xMax) << 1 | (y < yMin) << 2 | (y > yMax) << 3
+                | (!(x - x == 0) || !(y - y == 0)) << 4);
+        }
+    }
+
+    // Feeds the next n points of the polyline.
+    template <typename Sink>
+    void add(const double* xs, const double* ys, const unsigned char* codes, size_t n, Sink& sink) {
+        for (size_t i = 0; i < n; ++i) {
+            if (codes[i] & kInvalid) {
+                hasPrevious = open = false;
+                continue;
+            }
+            if (!hasPrevious) {
+                open = codes[i] == 0;
+                if (open) {
+                    sink.begin();
+                    sink.vertex(xs[i], ys[i]);
+                }
+            }
+            else if (codes[i] != 0 || previousCode != 0 || !open) {
+                segment(xs[i], ys[i], codes[i], sink);
+            }
+            else {
+                sink.vertex(xs[i], ys[i]); // inside to inside, the common case
+            }
+            hasPrevious = true;
+            previousX = xs[i];
+            previousY = ys[i];
+            previousCode = codes[i];
+        }
+    }
+
+    // The next point does not connect to the previous one.
+    void breakLine() {
+        hasPrevious = open = false;
+    }
+};
+
+// Drops vertices that barely change the drawn image, judged in screen space.
+// A run is cut into chunks that are simplified in parallel, each keeping
+// its end points. A chunk that is monotone in x (any function graph) is
+// reduced in linear time to at most four vertices per half-pixel column:
+// the first, lowest, highest and last, in their original order. That
+// keeps the vertical extent of every column, so the curve inks nearly the
+// same pixels, but only at the scale and column phase it was simplified
+// for; columns are counted from originX, which must land phaseX pixels
+// into its screen column. Other chunks go through Ramer–Douglas–Peucker
+// with a sub-pixel tolerance.
+class PolylineSimplifier {
+public:
+    static const int kChunkSize = 4096;
+    static const int kParallelThreshold = 16384;
+    static const int kColumnsPerPixel = 2;
+
+private:
+    double pixelsX, pixelsY; // pixels per world unit
+    double originX, phaseX;  // originX lands phaseX pixels into its screen column
+    double tolerance;        // in pixels
+
+    double columnOf(double x) const {
+        return std::floor(((x - originX) * pixelsX + phaseX) * kColumnsPerPixel);
+    }
+
+    bool isMonotone(const double* xs, size_t first, size_t last) const {
+        bool rising = true, falling = true;
+        for (size_t i = first; i < last; ++i) {
+            rising &= xs[i + 1] >= xs[i];
+            falling &= xs[i + 1] <= xs[i];
+        }
+        return rising || falling;
+    }
+
+    void decimateColumns(const double* xs, const double* ys, size_t first, size_t last,
+        std::vector<size_t>& keep) const {
+        size_t start = first;
+        while (start <= last) {
+            double column = columnOf(xs[start]);
+            size_t low = start, high = start, end = start;
+            while (end + 1 <= last && columnOf(xs[end + 1]) == column) {
+                ++end;
+                if (ys[end] < ys[low]) low = end;
+                if (ys[end] > ys[high]) high = end;
+            }
+            size_t picks[] = { start, std::min(low, high), std::max(low, high), end };
+            for (size_t pick : picks) {
+                if (keep.empty() || keep.back() < pick) {
+                    keep.push_back(pick);
+                }
+            }
+            start = end + 1;
+        }
+    }
+
+    void douglasPeucker(const double* xs, const double* ys, size_t first, size_t last,
+        std::vector<size_t>& keep) const {
+        std::vector<size_t> marked;
+        marked.push_back(first);
+        std::vector<std::pair<size_t, size_t>> stack(1, std::make_pair(first, last));
+        while (!stack.empty()) {
+            size_t a = stack.back().first, b = stack.back().second;
+            stack.pop_back();
+            double ax = xs[a] * pixelsX, ay = ys[a] * pixelsY;
+            double dx = xs[b] * pixelsX - ax, dy = ys[b] * pixelsY - ay;
+            double length = std::sqrt(dx * dx + dy * dy);
+            double worst = tolerance;
+            size_t split = a;
+            for (size_t i = a + 1; i < b; ++i) {
+                double px = xs[i] * pixelsX - ax, py = ys[i] * pixelsY - ay;
+                double distance = length > 0 ? std::fabs(px * dy - py * dx) / length : std::sqrt(px * px + py * py);
+                if (distance > worst) {
+                    worst = distance;
+                    split = i;
+                }
+            }
+            if (split != a) {
+                marked.push_back(split);
+                stack.push_back(std::make_pair(split, b));
+                stack.push_back(std::make_pair(a, split));
+            }
+        }
+        marked.push_back(last);
+        std::sort(marked.begin(), marked.end());
+        for (size_t index : marked) {
+            if (keep.empty() || keep.back() < index) {
+                keep.push_back(index);
+            }
+        }
+    }
+
+    void simplifyChunk(const double* xs, const double* ys, size_t first, size_t last,
+        std::vector<size_t>& keep) const {
+        if (isMonotone(xs, first, last)) {
+            decimateColumns(xs, ys, first, last, keep);
+        }
+        else {
+            douglasPeucker(xs, ys, first, last, keep);
+        }
+    }
+
+public:
+    // Position of screen x within its column, in pixels.
+    static double phaseOf(double screenX) {
+        double columns = screenX * kColumnsPerPixel;
+        return (columns - std::floor(columns)) / kColumnsPerPixel;
+    }
+
+    PolylineSimplifier(double pixelsPerUnitX, double pixelsPerUnitY, double columnOriginX = 0, double columnPhase = 0,
+        double tolerancePixels = 0.25)
+        : pixelsX(pixelsPerUnitX), pixelsY(pixelsPerUnitY), originX(columnOriginX), phaseX(columnPhase),
+          tolerance(tolerancePixels) {}
+
+    // Indices of the vertices of xs/ys[0, n) worth drawing, ascending;
+    // the first and last are always kept.
+    void simplify(const double* xs, const double* ys, size_t n, std::vector<size_t>& keep) const {
+        keep.clear();
+        if (n < 3) {
+            for (size_t i = 0; i < n; ++i) {
+                keep.push_back(i);
+            }
+            return;
+        }
+        if (n < static_cast<size_t>(kParallelThreshold)) {
+            simplifyChunk(xs, ys, 0, n - 1, keep);
+            return;
+        }
+        // Chunk c covers vertices [c*kChunkSize, (c+1)*kChunkSize], sharing
+        // its last vertex with the next chunk
+        int chunks = static_cast<int>((n - 2) / kChunkSize + 1);
+        std::vector<std::vector<size_t>> parts(chunks);
+        parallelFor(0, chunks, 1, [&](int begin, int end) {
+            for (int c = begin; c < end; ++c) {
+                size_t first = static_cast<size_t>(c) * kChunkSize;
+                simplifyChunk(xs, ys, first, std::min(first + kChunkSize, n - 1), parts[c]);
+            }
+        });
+        for (const auto& part : parts) {
+            for (size_t index : part) {
+                if (keep.empty() || keep.back() < index) {
+                    keep.push_back(index);
+                }
+            }
+        }
+    }
+};
+
+const int PolylineSimplifier::kChunkSize;
+const int PolylineSimplifier::kParallelThreshold;
+const int PolylineSimplifier::kColumnsPerPixel;
+
+// Turns polylines into one triangle strip of constant screen width. Points
+// are in local units that scale by (scaleX, scaleY) to pixels; the width is
+// applied in pixels and converted back, so the strip still goes through the
+// curve's transform. Joins are mitred, or bevelled where the miter would
+// exceed kMiterLimit half-widths; ends are butt. Several runs share the
+// strip, linked by degenerate triangles. Edges are smoothed by multisampling.
+class PolylineTessellator {
+public:
+    static const float kMiterLimit;
+
+private:
+    std::vector<float> normalX, normalY; // reused between calls
+
+    static void push(std::vector<sf::Vertex>& out, float x, float y, sf::Color color) {
+        out.push_back(sf::Vertex(sf::Vector2f(x, y), color));
+    }
+
+public:
+    // Appends the strip of xs/ys[0, n) to out.
+    void addRun(const float* xs, const float* ys, size_t n, float scaleX, float scaleY,
+        const GraphStyle& style, std::vector<sf::Vertex>& out) {
+        if (n < 2) {
+            return;
+        }
+        normalX.resize(n - 1);
+        normalY.resize(n - 1);
+        segmentNormalsKernel(xs, ys, n, scaleX, scaleY, normalX.data(), normalY.data());
+
+        float half = style.width / 2;
+        float toLocalX = half / scaleX, toLocalY = half / scaleY;
+        bool first = true;
+        float n0x = 0, n0y = 0; // normal of the segment arriving at point i
+        size_t next = 0;        // first non-degenerate segment at or after i
+        for (size_t i = 0; i < n; ++i) {
+            if (i > 0 && normalX[i - 1] == 0 && normalY[i - 1] == 0) {
+                continue; // same pixel as the previous point
+            }
+            next = std::max(next, i);
+            while (next < n - 1 && normalX[next] == 0 && normalY[next] == 0) {
+                ++next;
+            }
+            bool hasIn = !first, hasOut = next < n - 1;
+            if (!hasIn && !hasOut) {
+                return; // every point coincides
+            }
+            float n1x = hasOut ? normalX[next] : n0x, n1y = hasOut ? normalY[next] : n0y;
+            if (!hasIn) {
+                n0x = n1x;
+                n0y = n1y;
+            }
+            float x = xs[i], y = ys[i];
+            float cosine = n0x * n1x + n0y * n1y;
+            if (first && !out.empty()) {
+                // Degenerate link from the previous run
+                out.push_back(out.back());
+                push(out, x + n1x * toLocalX, y + n1y * toLocalY, style.color);
+            }
+            // (n0 + n1) / (1 + cos) points along the miter and is
+            // 1/cos(half the turn) long
+            if (1 + cosine >= 2 / (kMiterLimit * kMiterLimit)) {
+                float mx = (n0x + n1x) / (1 + cosine), my = (n0y + n1y) / (1 + cosine);
+                push(out, x + mx * toLocalX, y + my * toLocalY, style.color);
+                push(out, x - mx * toLocalX, y - my * toLocalY, style.color);
+            }
+            else {
+                // Bevel: end the incoming segment, start the outgoing one
+                push(out, x + n0x * toLocalX, y + n0y * toLocalY, style.color);
+                push(out, x - n0x * toLocalX, y - n0y * toLocalY, style.color);
+                push(out, x + n1x * toLocalX, y + n1y * toLocalY, style.color);
+                push(out, x - n1x * toLocalX, y - n1y * toLocalY, style.color);
+            }
+            first = false;
+            n0x = n1x;
+            n0y = n1y;
+        }
+    }
+};
+
+const float PolylineTessellator::kMiterLimit = 4.0f;
+
+// Places vertices stored relative to an origin: screen = local * scale +
+// offset on each axis. Kept in double; the origin is folded into the
+// offset, so float vertices only carry the small local offsets.
+struct LocalTransform {
+    double scaleX = 1, scaleY = 1, offsetX = 0, offsetY = 0;
+
+    sf::Transform toTransform() const {
+        return sf::Transform(
+            static_cast<float>(scaleX), 0, static_cast<float>(offsetX),
+            0, static_cast<float>(scaleY), static_cast<float>(offsetY),
+            0, 0, 1);
+    }
+
+    sf::FloatRect apply(const sf::FloatRect& rect) const {
+        double x0 = rect.left * scaleX + offsetX, x1 = (rect.left + rect.width) * scaleX + offsetX;
+        double y0 = rect.top * scaleY + offsetY, y1 = (rect.top + rect.height) * scaleY + offsetY;
+        return sf::FloatRect(static_cast<float>(std::min(x0, x1)), static_cast<float>(std::min(y0, y1)),
+            static_cast<float>(std::fabs(x1 - x0)), static_cast<float>(std::fabs(y1 - y0)));
+    }
+};
+
+// World-to-screen mapping derived from the CoordinateSystem ranges and the
+// area of the view they fill: screen = world * scale + offset, with y
+// pointing down on screen. Kept in double; only the final per-curve
+// matrix is handed to SFML in float.
+class ScreenMapping {
+private:
+    double scaleX = 1, scaleY = -1, offsetX = 0, offsetY = 0;
+
+    // A reversed range is swapped; an empty or non-finite one, which would
+    // give an infinite or NaN scale, is widened around its centre.
+    static Range usable(Range range) {
+        Range sorted(std::min(range.min, range.max), std::max(range.min, range.max));
+        double span = sorted.max - sorted.min;
+        if (span > 0 && std::isfinite(span)) {
+            return sorted;
+        }
+        double center = sorted.min + span / 2;
+        if (!std::isfinite(center)) {
+            center = 0;
+        }
+        double half = std::max(0.5, std::fabs(center) * 1e-12);
+        return Range(center - half, center + half);
+    }
+
+public:
+    ScreenMapping() {}
+
+    ScreenMapping(Range x, Range y, const sf::FloatRect& area) {
+        x = usable(x);
+        y = usable(y);
+        scaleX = area.width / (x.max - x.min);
+        scaleY = -area.height / (y.max - y.min);
+        offsetX = area.left - x.min * scaleX;
+        offsetY = area.top - y.max * scaleY;
+    }
+
+    double toScreenX(double x) const { return x * scaleX + offsetX; }
+    double toScreenY(double y) const { return y * scaleY + offsetY; }
+    double pixelsPerUnitX() const { return scaleX; }
+    double pixelsPerUnitY() const { return -scaleY; }
+
+    // Placement of vertices stored relative to (originX, originY).
+    LocalTransform transformFrom(double originX, double originY) const {
+        LocalTransform transform;
+        transform.scaleX = scaleX;
+        transform.scaleY = scaleY;
+        transform.offsetX = originX * scaleX + offsetX;
+        transform.offsetY = originY * scaleY + offsetY;
+        return transform;
+    }
+};
+
+// RGBA8 framebuffer with the drawing primitives of the software renderer:
+// rectangle fills, anti-aliased thick lines and a bitmap glyph blitter.
+// Pixel (x, y) covers [x, x + 1) x [y, y + 1). Each primitive only writes
+// inside the given area, which must lie within the buffer; the overloads
+// without one use the clip rectangle, the whole buffer by default. Calls
+// with disjoint areas may run concurrently.
+class SoftwareRasterizer {
+private:
+    unsigned width = 0, height = 0;
+    std::vector<std::uint32_t> pixels; // R, G, B, A bytes in memory order
+    sf::IntRect clip;
+
+    static std::uint32_t pack(sf::Color color) {
+        const std::uint8_t bytes[4] = { color.r, color.g, color.b, 255 };
+        std::uint32_t packed;
+        std::memcpy(&packed, bytes, 4);
+        return packed;
+    }
+
+    // Opacity 0..256 of a color at the given coverage.
+    static unsigned opacity(sf::Color color, float coverage) {
+        return static_cast<unsigned>(coverage * color.a * (256.0f / 255.0f) + 0.5f);
+    }
+
+    static void fillSpan(std::uint32_t* out, size_t n, std::uint32_t color) {
+        size_t i = 0;
+#ifdef PLOTTER_SSE2
+        __m128i value = _mm_set1_epi32(static_cast<int>(color));
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), value);
+        }
+#endif
+        for (; i < n; ++i) {
+            out[i] = color;
+        }
+    }
+
+    // out = (out * (256 - alpha) + color * alpha) / 256 per channel.
+    static void blendSpan(std::uint32_t* out, size_t n, std::uint32_t color, unsigned alpha) {
+        if (alpha >= 256) {
+            fillSpan(out, n, color);
+            return;
+        }
+        if (alpha == 0) {
+            return;
+        }
+        size_t i = 0;
+#ifdef PLOTTER_SSE2
+        // Channels widened to 16 bits: at most 255 * 256, no overflow
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i source = _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(color)), zero),
+            _mm_set1_epi16(static_cast<short>(alpha)));
+        const __m128i keep = _mm_set1_epi16(static_cast<short>(256 - alpha));
+        for (; i + 4 <= n; i += 4) {
+            __m128i pixels4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(out + i));
+            __m128i low = _mm_unpacklo_epi8(pixels4, zero), high = _mm_unpackhi_epi8(pixels4, zero);
+            low = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(low, keep), source), 8);
+            high = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(high, keep), source), 8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(low, high));
+        }
+#endif
+        const std::uint8_t* source8 = reinterpret_cast<const std::uint8_t*>(&color);
+        for (; i < n; ++i) {
+            std::uint8_t* pixel = reinterpret_cast<std::uint8_t*>(out + i);
+            for (int c = 0; c < 4; ++c) {
+                pixel[c] = static_cast<std::uint8_t>((pixel[c] * (256 - alpha) + source8[c] * alpha) >> 8);
+            }
+        }
+    }
+
+    // 5x7 glyphs for what tick and axis labels use; a row per byte, the
+    // leftmost pixel in bit 4.
+    struct BitmapGlyph {
+        char character;
+        std::uint8_t rows[7];
+    };
+
+    static const BitmapGlyph* findGlyph(char character) {
+        static const BitmapGlyph glyphs[] = {
+            { '0', { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E } },
+            { '1', { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E } },
+            { '2', { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F } },
+            { '3', { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E } },
+            { '4', { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 } },
+            { '5', { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E } },
+            { '6', { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E } },
+            { '7', { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 } },
+            { '8', { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E } },
+            { '9', { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C } },
+            { '-', { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 } },
+            { '+', { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 } },
+            { '.', { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C } },
+            { 'e', { 0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E } },
+            { 'X', { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 } },
+            { 'Y', { 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04 } },
+        };
+        for (const BitmapGlyph& glyph : glyphs) {
+            if (glyph.character == character) {
+                return &glyph;
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    void resize(unsigned newWidth, unsigned newHeight) {
+        width = newWidth;
+        height = newHeight;
+        pixels.assign(static_cast<size_t>(width) * height, pack(sf::Color::White));
+        clip = sf::IntRect(0, 0, static_cast<int>(width), static_cast<int>(height));
+    }
+
+    unsigned getWidth() const { return width; }
+    unsigned getHeight() const { return height; }
+
+    // Width * height * 4 bytes, rows top to bottom, as sf::Image takes them.
+    const std::uint8_t* getPixels() const {
+        return reinterpret_cast<const std::uint8_t*>(pixels.data());
+    }
+
+    void setClip(const sf::IntRect& rect) {
+        int left = std::max(rect.left, 0), top = std::max(rect.top, 0);
+        int right = std::min(rect.left + rect.width, static_cast<int>(width));
+        int bottom = std::min(rect.top + rect.height, static_cast<int>(height));
+        clip = sf::IntRect(left, top, std::max(right - left, 0), std::max(bottom - top, 0));
+    }
+
+    const sf::IntRect& getClip() const {
+        return clip;
+    }
+
+    void clear(sf::Color color) { clear(color, clip); }
+
+    void clear(sf::Color color, const sf::IntRect& area) {
+        std::uint32_t value = pack(color);
+        for (int y = area.top; y < area.top + area.height; ++y) {
+            fillSpan(&pixels[static_cast<size_t>(y) * width + area.left], area.width, value);
+        }
+    }
+
+    void fillRect(const sf::FloatRect& rect, sf::Color color) { fillRect(rect, color, clip); }
+
+    // Fractional edges are blended by the covered area.
+    void fillRect(const sf::FloatRect& rect, sf::Color color, const sf::IntRect& area) {
+        float x0 = std::max(rect.left, static_cast<float>(area.left));
+        float y0 = std::max(rect.top, static_cast<float>(area.top));
+        float x1 = std::min(rect.left + rect.width, static_cast<float>(area.left + area.width));
+        float y1 = std::min(rect.top + rect.height, static_cast<float>(area.top + area.height));
+        if (!(x1 > x0 && y1 > y0)) {
+            return;
+        }
+        std::uint32_t value = pack(color);
+        int left = static_cast<int>(std::floor(x0)), right = static_cast<int>(std::ceil(x1));
+        int top = static_cast<int>(std::floor(y0)), bottom = static_cast<int>(std::ceil(y1));
+        float leftCoverage = std::min(left + 1.0f, x1) - x0;
+        float rightCoverage = x1 - std::max(right - 1.0f, x0);
+        for (int y = top; y < bottom; ++y) {
+            float rowCoverage = std::min(y + 1.0f, y1) - std::max(static_cast<float>(y), y0);
+            std::uint32_t* row = &pixels[static_cast<size_t>(y) * width];
+            if (right - left == 1) {
+                blendSpan(row + left, 1, value, opacity(color, rowCoverage * (x1 - x0)));
+                continue;
+            }
+            blendSpan(row + left, 1, value, opacity(color, rowCoverage * leftCoverage));
+            blendSpan(row + left + 1, right - left - 2, value, opacity(color, rowCoverage));
+            blendSpan(row + right - 1, 1, value, opacity(color, rowCoverage * rightCoverage));
+        }
+    }
+
+    void strokeSegment(float x0, float y0, float x1, float y1, float lineWidth, sf::Color color) {
+        strokeSegment(x0, y0, x1, y1, lineWidth, color, clip);
+    }
+
+    // A line of the given width with round ends. Coverage falls off over
+    // one pixel at the edge, from the distance of each pixel centre to the
+    // segment; each row only visits the pixels near the line.
+    void strokeSegment(float x0, float y0, float x1, float y1, float lineWidth, sf::Color color, const sf::IntRect& area) {
+        float reach = lineWidth / 2 + 0.5f;
+        float dx = x1 - x0, dy = y1 - y0;
+        float length = std::sqrt(dx * dx + dy * dy);
+        int left = std::max(area.left, static_cast<int>(std::max(std::floor(std::min(x0, x1) - reach), -1e9f)));
+        int right = std::min(area.left + area.width, static_cast<int>(std::min(std::ceil(std::max(x0, x1) + reach), 1e9f)));
+        int top = std::max(area.top, static_cast<int>(std::max(std::floor(std::min(y0, y1) - reach), -1e9f)));
+        int bottom = std::min(area.top + area.height, static_cast<int>(std::min(std::ceil(std::max(y0, y1) + reach), 1e9f)));
+        if (left >= right || top >= bottom || !(length < INFINITY)) {
+            return;
+        }
+        float inverseSquared = length > 0 ? 1 / (length * length) : 0;
+        std::uint32_t value = pack(color);
+        for (int y = top; y < bottom; ++y) {
+            float cy = y + 0.5f;
+            int from = left, to = right;
+            if (std::fabs(dy) > 1e-3f * length) {
+                // Pixel centres within reach of the infinite line
+                float along = x0 + (cy - y0) * dx / dy, spread = reach * length / std::fabs(dy);
+                from = std::max(from, static_cast<int>(std::floor(along - spread)));
+                to = std::min(to, static_cast<int>(std::ceil(along + spread)) + 1);
+            }
+            std::uint32_t* row = &pixels[static_cast<size_t>(y) * width];
+            for (int x = from; x < to; ++x) {
+                float px = x + 0.5f - x0, py = cy - y0;
+                float t = std::min(1.0f, std::max(0.0f, (px * dx + py * dy) * inverseSquared));
+                float ex = px - t * dx, ey = py - t * dy;
+                float coverage = reach - std::sqrt(ex * ex + ey * ey);
+                if (coverage > 0) {
+                    blendSpan(row + x, 1, value, opacity(color, std::min(coverage, 1.0f)));
+                }
+            }
+        }
+    }
+
+    // Pixels a segment drawn by strokeSegment can touch.
+    static sf::IntRect segmentBounds(float x0, float y0, float x1, float y1, float lineWidth) {
+        float reach = lineWidth / 2 + 0.5f;
+        return boundsOf(std::min(x0, x1) - reach, std::min(y0, y1) - reach,
+            std::max(x0, x1) + reach, std::max(y0, y1) + reach);
+    }
+
+    // Whole pixels covering [x0, x1) x [y0, y1), kept within int range.
+    static sf::IntRect boundsOf(float x0, float y0, float x1, float y1) {
+        if (!(x0 <= x1 && y0 <= y1)) {
+            return sf::IntRect();
+        }
+        int left = static_cast<int>(std::max(std::floor(x0), -1e9f)), top = static_cast<int>(std::max(std::floor(y0), -1e9f));
+        int right = static_cast<int>(std::min(std::ceil(x1), 1e9f)), bottom = static_cast<int>(std::min(std::ceil(y1), 1e9f));
+        return sf::IntRect(left, top, right - left, bottom - top);
+    }
+
+    static float glyphScale(unsigned size) {
+        return std::max(1.0f, std::floor(size / 7.5f + 0.5f));
+    }
+
+    // Pixels drawText can touch.
+    static sf::IntRect textBounds(const char* text, float x, float y, unsigned size) {
+        float scale = glyphScale(size);
+        float penX = std::floor(x + 0.5f), penY = std::floor(y + size * 0.2f + 0.5f);
+        return boundsOf(penX, penY, penX + std::strlen(text) * 6 * scale, penY + 7 * scale);
+    }
+
+    void drawText(const char* text, float x, float y, unsigned size, sf::Color color) {
+        drawText(text, x, y, size, color, clip);
+    }
+
+    // Bitmap text, its cell top left at (x, y); the 5x7 glyphs are scaled
+    // by whole pixels to roughly the given character size. Characters
+    // without a glyph leave a gap.
+    void drawText(const char* text, float x, float y, unsigned size, sf::Color color, const sf::IntRect& area) {
+        float scale = glyphScale(size);
+        float penX = std::floor(x + 0.5f), penY = std::floor(y + size * 0.2f + 0.5f);
+        for (const char* c = text; *c; ++c, penX += 6 * scale) {
+            const BitmapGlyph* glyph = findGlyph(*c);
+            if (!glyph) {
+                continue;
+            }
+            for (int row = 0; row < 7; ++row) {
+                // One rectangle per run of set bits
+                for (int column = 0; column < 5;) {
+                    if (!(glyph->rows[row] & (0x10 >> column))) {
+                        ++column;
+                        continue;
+                    }
+                    int start = column;
+                    while (column < 5 && (glyph->rows[row] & (0x10 >> column))) {
+                        ++column;
+                    }
+                    fillRect(sf::FloatRect(penX + start * scale, penY + row * scale, (column - start) * scale, scale), color, area);
+                }
+            }
+        }
+    }
+};
+
+// A curve ready to draw: its simplified runs and the outline tessellated
+// from them, both in local units placed on screen by `placement`.
+struct CurveGeometry {
+    const float* pathX;
+    const float* pathY;
+    const size_t* runEnds;
+    size_t runCount;
+    const sf::Vertex* outline;
+    size_t outlineCount;
+    LocalTransform placement;
+    GraphStyle style;
+};
+
+// What GraphPlotter draws its scene through, in view coordinates (the
+// view follows the window, so these are pixels).
+class RenderBackend {
+public:
+    virtual ~RenderBackend() {}
+    virtual void clear(sf::Color color) = 0;
+    // 1 px lines, two vertices each.
+    virtual void drawLines(const sf::Vertex* vertices, size_t count) = 0;
+    virtual void drawCurve(const CurveGeometry& curve) = 0;
+    // False while text cannot be drawn yet (the font is still loading).
+    virtual bool canDrawText() = 0;
+    virtual void drawText(const char* text, float x, float y, unsigned size, sf::Color color) = 0;
+    // Called once the scene is complete, before its temporaries are freed.
+    virtual void endScene() {}
+};
+
+// Draws on an SFML target: the window or a render texture.
+class SfmlBackend : public RenderBackend {
+private:
+    sf::RenderTarget* target = nullptr;
+    std::shared_ptr<const sf::Font> font; // shared with ResourceManager
+    std::string fontFile;
+
+    // sf::Text objects are kept between frames; a label's string is only
+    // re-set when its text changes.
+    struct Label {
+        sf::Text text;
+        char content[16];
+    };
+    std::vector<Label> labels;
+    size_t nextLabel = 0;
+    size_t drawCalls = 0;
+
+public:
+    explicit SfmlBackend(const std::string& fontFilename) : fontFile(fontFilename) {}
+
+    void setTarget(sf::RenderTarget& newTarget) {
+        target = &newTarget;
+    }
+
+    // Labels are reused in drawing order; called before each scene.
+    void beginScene() {
+        nextLabel = 0;
+    }
+
+    size_t getDrawCalls() const { return drawCalls; }
+    void resetDrawCalls() { drawCalls = 0; }
+
+    void clear(sf::Color color) override {
+        target->clear(color);
+    }
+
+    void drawLines(const sf::Vertex* vertices, size_t count) override {
+        target->draw(vertices, count, sf::Lines);
+        ++drawCalls;
+    }
+
+    void drawCurve(const CurveGeometry& curve) override {
+        if (curve.outlineCount > 0) {
+            target->draw(curve.outline, curve.outlineCount, sf::TriangleStrip, sf::RenderStates(curve.placement.toTransform()));
+            ++drawCalls;
+        }
+    }
+
+    bool canDrawText() override {
+        if (!font) {
+            font = ResourceManager::instance().getFont(fontFile);
+        }
+        return font != nullptr;
+    }
+
+    // True while the font is still loading: text is skipped now but can be
+    // drawn later. False once it loaded or failed for good.
+    bool isTextPending() {
+        return !canDrawText() && ResourceManager::instance().isLoading(fontFile);
+    }
+
+    void drawText(const char* content, float x, float y, unsigned size, sf::Color color) override {
+        if (nextLabel == labels.size()) {
+            labels.emplace_back();
+            labels.back().content[0] = '\0';
+            labels.back().text.setFont(*font);
+        }
+        Label& label = labels[nextLabel++];
+        if (std::strcmp(label.content, content) != 0) {
+            size_t length = std::min(std::strlen(content), sizeof(label.content) - 1);
+            std::memcpy(label.content, content, length);
+            label.content[length] = '\0';
+            label.text.setString(label.content);
+        }
+        label.text.setFillColor(color);
+        label.text.setCharacterSize(size);
+        label.text.setPosition(x, y);
+        target->draw(label.text);
+        ++drawCalls;
+    }
+};
+
+// Draws into a SoftwareRasterizer; needs no window, GPU or font file.
+// Curves are stroked from their simplified points rather than from the
+// GPU outline, with round joins.
+//
+// Drawing calls only record commands. endScene() bins them into screen
+// tiles and rasterizes the tiles in parallel, each clipped to itself, so
+// no two threads write the same pixels and the framebuffer needs no
+// locks. Binning runs in parallel too: each slice of the command list
+// fills its own bins, and a tile replays the slices in order, which keeps
+// the drawing order. Curves are recorded in pieces of kPieceSegments
+// segments, so that a tile only visits the parts of a curve that cross it.
+class SoftwareBackend : public RenderBackend {
+public:
+    static const int kTileSize = 128;      // 64 KB of pixels, stays in L2
+    static const int kPieceSegments = 64;
+    static const int kSliceCommands = 4096;
+    static const int kMaxSlices = 16;
+
+private:
+    SoftwareRasterizer& raster;
+    TaskScheduler& scheduler;
+
+    struct Command {
+        enum Kind : std::uint8_t { Clear, Rect, Segment, Text, Piece } kind;
+        sf::Color color;
+        float x0, y0, x1, y1, width; // Rect: left, top, right, bottom; Text: x, y, size
+        std::uint32_t item;          // Text: label index; Piece: curve index
+        std::uint32_t first, last;   // Piece: points [first, last] of the curve
+    };
+    std::vector<Command> commands;
+    std::vector<CurveGeometry> curves;
+    struct TextLabel {
+        char content[16];
+    };
+    std::vector<TextLabel> texts;
+
+    // bins[slice * tileCount + tile]: indices of the commands of a slice
+    // that touch a tile, in order. Kept between scenes for their capacity.
+    std::vector<std::vector<std::uint32_t>> bins;
+
+    sf::Vector2f piecePoint(const Command& command, size_t i) const {
+        const CurveGeometry& curve = curves[command.item];
+        const LocalTransform& place = curve.placement;
+        return sf::Vector2f(static_cast<float>(curve.pathX[i] * place.scaleX + place.offsetX),
+            static_cast<float>(curve.pathY[i] * place.scaleY + place.offsetY));
+    }
+
+    sf::IntRect boundsOf(const Command& command) const {
+        switch (command.kind) {
+        case Command::Clear:
+            return raster.getClip();
+        case Command::Rect:
+            return SoftwareRasterizer::boundsOf(command.x0, command.y0, command.x1, command.y1);
+        case Command::Segment:
+            return SoftwareRasterizer::segmentBounds(command.x0, command.y0, command.x1, command.y1, command.width);
+        case Command::Text:
+            return SoftwareRasterizer::textBounds(texts[command.item].content, command.x0, command.y0,
+                static_cast<unsigned>(command.width));
+        case Command::Piece:
+        default:
+        {
+            float left = INFINITY, top = INFINITY, right = -INFINITY, bottom = -INFINITY;
+            for (size_t i = command.first; i <= command.last; ++i) {
+                sf::Vector2f point = piecePoint(command, i);
+                left = std::min(left, point.x);
+                right = std::max(right, point.x);
+                top = std::min(top, point.y);
+                bottom = std::max(bottom, point.y);
+            }
+            float reach = curves[command.item].style.width / 2 + 0.5f;
+            return SoftwareRasterizer::boundsOf(left - reach, top - reach, right + reach, bottom + reach);
+        }
+        }
+    }
+
+    void execute(const Command& command, const sf::IntRect& area) {
+        switch (command.kind) {
+        case Command::Clear:
+            raster.clear(command.color, area);
+            break;
+        case Command::Rect:
+            raster.fillRect(sf::FloatRect(command.x0, command.y0, command.x1 - command.x0, command.y1 - command.y0),
+                command.color, area);
+            break;
+        case Command::Segment:
+            raster.strokeSegment(command.x0, command.y0, command.x1, command.y1, command.width, command.color, area);
+            break;
+        case Command::Text:
+            raster.drawText(texts[command.item].content, command.x0, command.y0, static_cast<unsigned>(command.width),
+                command.color, area);
+            break;
+        case Command::Piece:
+        {
+            const GraphStyle& style = curves[command.item].style;
+            sf::Vector2f previous = piecePoint(command, command.first);
+            for (size_t i = command.first + 1; i <= command.last; ++i) {
+                sf::Vector2f point = piecePoint(command, i);
+                raster.strokeSegment(previous.x, previous.y, point.x, point.y, style.width, style.color, area);
+                previous = point;
+            }
+            break;
+        }
+        }
+    }
+
+    void record(Command::Kind kind, sf::Color color, float x0, float y0, float x1, float y1, float width) {
+        Command command = { kind, color, x0, y0, x1, y1, width, 0, 0, 0 };
+        commands.push_back(command);
+    }
+
+public:
+    explicit SoftwareBackend(SoftwareRasterizer& target, TaskScheduler& workers = TaskScheduler::instance())
+        : raster(target), scheduler(workers) {}
+
+    void clear(sf::Color color) override {
+        record(Command::Clear, color, 0, 0, 0, 0, 0);
+    }
+
+    void drawLines(const sf::Vertex* vertices, size_t count) override {
+        for (size_t i = 0; i + 1 < count; i += 2) {
+            sf::Vector2f a = vertices[i].position, b = vertices[i + 1].position;
+            // Grid and axes are axis-aligned: crisp 1 px rectangles
+            if (a.x == b.x) {
+                record(Command::Rect, vertices[i].color, std::floor(a.x), std::min(a.y, b.y), std::floor(a.x) + 1, std::max(a.y, b.y), 0);
+            }
+            else if (a.y == b.y) {
+                record(Command::Rect, vertices[i].color, std::min(a.x, b.x), std::floor(a.y), std::max(a.x, b.x), std::floor(a.y) + 1, 0);
+            }
+            else {
+                record(Command::Segment, vertices[i].color, a.x, a.y, b.x, b.y, 1);
+            }
+        }
+    }
+
+    // The geometry must stay alive until endScene().
+    void drawCurve(const CurveGeometry& curve) override {
+        std::uint32_t index = static_cast<std::uint32_t>(curves.size());
+        curves.push_back(curve);
+        size_t start = 0;
+        for (size_t run = 0; run < curve.runCount; start = curve.runEnds[run++]) {
+            for (size_t first = start; first + 1 < curve.runEnds[run]; first += kPieceSegments) {
+                Command command = { Command::Piece, curve.style.color, 0, 0, 0, 0, 0, index,
+                    static_cast<std::uint32_t>(first),
+                    static_cast<std::uint32_t>(std::min(first + kPieceSegments, curve.runEnds[run] - 1)) };
+                commands.push_back(command);
+            }
+        }
+    }
+
+    bool canDrawText() override {
+        return true;
+    }
+
+    void drawText(const char* text, float x, float y, unsigned size, sf::Color color) override {
+        TextLabel label;
+        size_t length = std::min(std::strlen(text), sizeof(label.content) - 1);
+        std::memcpy(label.content, text, length);
+        label.content[length] = '\0';
+        record(Command::Text, color, x, y, 0, 0, static_cast<float>(size));
+        commands.back().item = static_cast<std::uint32_t>(texts.size());
+        texts.push_back(label);
+    }
+
+    void endScene() override {
+        const sf::IntRect clip = raster.getClip();
+        int tilesX = (clip.width + kTileSize - 1) / kTileSize, tilesY = (clip.height + kTileSize - 1) / kTileSize;
+        int tileCount = tilesX * tilesY;
+        int commandCount = static_cast<int>(commands.size());
+        int slices = std::max(1, std::min(kMaxSlices, commandCount / kSliceCommands));
+        if (bins.size() < static_cast<size_t>(slices) * tileCount) {
+            bins.resize(static_cast<size_t>(slices) * tileCount);
+        }
+
+        parallelFor(0, slices, 1, [&](int begin, int end) {
+            for (int slice = begin; slice < end; ++slice) {
+                std::vector<std::uint32_t>* sliceBins = &bins[static_cast<size_t>(slice) * tileCount];
+                for (int tile = 0; tile < tileCount; ++tile) {
+                    sliceBins[tile].clear();
+                }
+                int first = static_cast<int>(static_cast<long long>(commandCount) * slice / slices);
+                int last = static_cast<int>(static_cast<long long>(commandCount) * (slice + 1) / slices);
+                for (int i = first; i < last; ++i) {
+                    sf::IntRect bounds = boundsOf(commands[i]);
+                    int x0 = std::max(bounds.left, clip.left) - clip.left;
+                    int y0 = std::max(bounds.top, clip.top) - clip.top;
+                    int x1 = std::min(bounds.left + bounds.width, clip.left + clip.width) - clip.left;
+                    int y1 = std::min(bounds.top + bounds.height, clip.top + clip.height) - clip.top;
+                    if (x0 >= x1 || y0 >= y1) {
+                        continue;
+                    }
+                    for (int ty = y0 / kTileSize; ty <= (y1 - 1) / kTileSize; ++ty) {
+                        for (int tx = x0 / kTileSize; tx <= (x1 - 1) / kTileSize; ++tx) {
+                            sliceBins[ty * tilesX + tx].push_back(static_cast<std::uint32_t>(i));
+                        }
+                    }
+                }
+            }
+        }, scheduler);
+
+        parallelFor(0, tileCount, 1, [&](int begin, int end) {
+            for (int tile = begin; tile < end; ++tile) {
+                int left = clip.left + tile % tilesX * kTileSize, top = clip.top + tile / tilesX * kTileSize;
+                sf::IntRect area(left, top, std::min(kTileSize, clip.left + clip.width - left),
+                    std::min(kTileSize, clip.top + clip.height - top));
+                for (int slice = 0; slice < slices; ++slice) {
+                    for (std::uint32_t index : bins[static_cast<size_t>(slice) * tileCount + tile]) {
+                        execute(commands[index], area);
+                    }
+                }
+            }
+        }, scheduler);
+
+        commands.clear();
+        curves.clear();
+        texts.clear();
+    }
+};
+
+const int SoftwareBackend::kTileSize;
+const int SoftwareBackend::kPieceSegments;
+const int SoftwareBackend::kSliceCommands;
+const int SoftwareBackend::kMaxSlices;
+
+
+class GraphPlotter {
+private:
+    PlotArea* plotArea;
+    FrameArena frameArena; // per-frame temporaries, reset in display()
+    SfmlBackend screen = SfmlBackend("arial.ttf"); // the window and its render textures
+
+    // World-space geometry of a graph, drawn through a transform so that
+    // panning only changes the matrix. The curve is clipped to the view
+    // plus one view size on each side and simplified for the current scale;
+    // points are stored relative to an origin near the view, as float
+    // loses precision far from zero. They are rebuilt when the samples
+    // change, when the view leaves the clip window, when zooming in past
+    // the scale they were simplified for, or when the view moves far from
+    // the origin compared to its size. The outline, one triangle strip for
+    // all runs, is re-tessellated from the points when the scale or the
+    // style changes, as its width is in pixels.
+    struct CurveCache {
+        unsigned revision = 0;
+        bool built = false;
+        Range window = Range(0, 0);  // data x range the points cover
+        Range windowY = Range(0, 0); // and y; the curve is clipped to both
+        double originX = 0, originY = 0;
+        std::vector<float> pathX, pathY; // simplified runs, relative to the origin
+        std::vector<size_t> runEnds;     // end of each run in pathX/pathY
+        std::vector<sf::Vertex> outline;
+        GraphStyle outlineStyle;
+        double outlineScaleX = 0, outlineScaleY = 0;
+        sf::FloatRect localBounds; // of the outline
+        LocalTransform transform;
+        sf::FloatRect bounds; // screen area as last drawn, for damage tracking
+        bool drawn = false;
+        bool used = false;
+        double pixelsX = 0, pixelsY = 0; // scale the points were simplified for
+        double phaseX = 0;               // and column phase of the origin
+        size_t clippedVertices = 0;      // before simplification
+        size_t vertexCount = 0;          // after
+
+        size_t memoryBytes() const {
+            return (pathX.capacity() + pathY.capacity()) * sizeof(float) + runEnds.capacity() * sizeof(size_t)
+                + outline.capacity() * sizeof(sf::Vertex);
+        }
+
+        CurveGeometry geometry() const {
+            CurveGeometry curve = { pathX.data(), pathY.data(), runEnds.data(), runEnds.size(),
+                outline.data(), outline.size(), transform, outlineStyle };
+            return curve;
+        }
+    };
+
+    // A view this many times its own size away from the vertex origin
+    // would lose about a tenth of a pixel to float rounding.
+    static const int kRebaseRatio = 1000;
+    static constexpr double kPhaseTolerance = 1.0 / 64; // pixels
+    std::unordered_map<unsigned, CurveCache> curves; // by graph handle
+
+    // Grid and axes lines, pairs of vertices, rebuilt with the background.
+    std::vector<sf::Vertex> gridLines;
+    std::vector<sf::Vertex> axisLines;
+    ScreenMapping mapping;
+    sf::FloatRect viewArea;
+
+    // Grid, axes and tick labels rendered once into a texture at the
+    // window's pixel size and composited every frame. Rebuilt when the
+    // ranges, the window size or the view change, and until the font has
+    // loaded (the labels are missing before that). Render textures are GL
+    // resources, and constructing one brings up SFML's GL context, so both
+    // are only created by the window path; headless rendering never does.
+    std::unique_ptr<sf::RenderTexture> background;
+    sf::Sprite backgroundSprite;
+    bool backgroundValid = false;
+    bool backgroundAwaitsFont = false; // drawn without labels, font still loading
+    bool backgroundAvailable = true; // false if render textures are unsupported
+    sf::Vector2u backgroundSize;
+    sf::Vector2f backgroundViewSize;
+    Range backgroundX = Range(0, 0), backgroundY = Range(0, 0);
+    size_t drawCalls = 0;
+    size_t lastDrawCalls = 0;
+
+    // The composed frame persists in its own texture, so a frame only has
+    // to repaint what changed: the old and new areas of changed curves.
+    // Nothing changed means no drawing and no display() at all.
+    std::unique_ptr<sf::RenderTexture> frame;
+    sf::Sprite frameSprite;
+    bool frameAvailable = true;
+    sf::Vector2u frameSize;
+    DamageRegion damage;
+    std::vector<const CurveCache*> drawOrder;
+    size_t repaintedFrames = 0, skippedFrames = 0;
+
+    // Formats a tick value into frame memory.
+    const char* formatTick(double value) {
+        char* buffer = frameArena.allocateArray<char>(16);
+        std::snprintf(buffer, 16, "%.6g", value);
+        return buffer;
+    }
+
+    // Grid spacing of 1, 2 or 5 times a power of ten giving lines about
+    // targetPixels apart.
+    static double tickStep(double span, double pixels, double targetPixels = 40) {
+        double raw = span * targetPixels / pixels;
+        double magnitude = std::pow(10.0, std::floor(std::log10(raw)));
+        double normalized = raw / magnitude;
+        return (normalized < 1.5 ? 1 : normalized < 3.5 ? 2 : normalized < 7.5 ? 5 : 10) * magnitude;
+    }
+
+    // Ticks at (first + i) * step for i in [0, count). The count comes from
+    // the range, not from stepping a double: far from zero, adding 1 to a
+    // multiplier past 2^53 no longer changes it. Capped at kMaxTicks.
+    struct Ticks {
+        double first;
+        int count;
+    };
+    static const int kMaxTicks = 1000;
+
+    static Ticks ticksOf(Range range, double step) {
+        Ticks ticks = { std::ceil(range.min / step), 0 };
+        double count = std::floor(range.max / step) - ticks.first + 1;
+        if (count > 0) {
+            ticks.count = static_cast<int>(std::min(count, static_cast<double>(kMaxTicks)));
+        }
+        return ticks;
+    }
+
+    // Screen position of the axes: the zero lines, kept inside the view
+    // when zero is off screen.
+    float axisScreenX() const {
+        return static_cast<float>(std::min<double>(std::max<double>(mapping.toScreenX(0), viewArea.left),
+            viewArea.left + viewArea.width - 1));
+    }
+
+    float axisScreenY() const {
+        return static_cast<float>(std::min<double>(std::max<double>(mapping.toScreenY(0), viewArea.top),
+            viewArea.top + viewArea.height - 1));
+    }
+
+    void buildLines(const CoordinateSystem& cs) {
+        const sf::Color gridColor(200, 200, 200);
+        Range x = cs.getXRange(), y = cs.getYRange();
+        float left = viewArea.left, top = viewArea.top;
+        float right = left + viewArea.width, bottom = top + viewArea.height;
+
+        gridLines.clear();
+        double stepX = tickStep(x.max - x.min, viewArea.width);
+        Ticks ticksX = ticksOf(x, stepX);
+        for (int i = 0; i < ticksX.count; ++i) {
+            float sx = static_cast<float>(mapping.toScreenX((ticksX.first + i) * stepX));
+            gridLines.push_back(sf::Vertex(sf::Vector2f(sx, top), gridColor));
+            gridLines.push_back(sf::Vertex(sf::Vector2f(sx, bottom), gridColor));
+        }
+        double stepY = tickStep(y.max - y.min, viewArea.height);
+        Ticks ticksY = ticksOf(y, stepY);
+        for (int i = 0; i < ticksY.count; ++i) {
+            float sy = static_cast<float>(mapping.toScreenY((ticksY.first + i) * stepY));
+            gridLines.push_back(sf::Vertex(sf::Vector2f(left, sy), gridColor));
+            gridLines.push_back(sf::Vertex(sf::Vector2f(right, sy), gridColor));
+        }
+
+        float axisX = axisScreenX(), axisY = axisScreenY();
+        axisLines.clear();
+        axisLines.push_back(sf::Vertex(sf::Vector2f(left, axisY), sf::Color::Black));   // X axis
+        axisLines.push_back(sf::Vertex(sf::Vector2f(right, axisY), sf::Color::Black));
+        axisLines.push_back(sf::Vertex(sf::Vector2f(axisX, top), sf::Color::Black));    // Y axis
+        axisLines.push_back(sf::Vertex(sf::Vector2f(axisX, bottom), sf::Color::Black));
+    }
+
+    void drawAxes(RenderBackend& backend) {
+        backend.drawLines(axisLines.data(), axisLines.size());
+
+        // Label the axes
+        if (!backend.canDrawText()) {
+            return;
+        }
+        backend.drawText("X", viewArea.left + viewArea.width - 20, axisScreenY() + 10, 20, sf::Color::Black);
+        backend.drawText("Y", axisScreenX() + 20, viewArea.top + 10, 20, sf::Color::Black);
+    }
+
+    void drawGrid(RenderBackend& backend) {
+        backend.drawLines(gridLines.data(), gridLines.size());
+
+        if (!backend.canDrawText()) {
+            return; // labels appear once the font has loaded
+        }
+
+        // Tick labels along the axes; zero is left out, where they cross
+        const CoordinateSystem& cs = plotArea->getCoordinateSystem();
+        Range x = cs.getXRange(), y = cs.getYRange();
+        float axisX = axisScreenX(), axisY = axisScreenY();
+        double stepX = tickStep(x.max - x.min, viewArea.width);
+        Ticks ticksX = ticksOf(x, stepX);
+        for (int i = 0; i < ticksX.count; ++i) {
+            double k = ticksX.first + i;
+            if (k != 0) {
+                backend.drawText(formatTick(k * stepX), static_cast<float>(mapping.toScreenX(k * stepX)), axisY + 10, 15, sf::Color::Black);
+            }
+        }
+        double stepY = tickStep(y.max - y.min, viewArea.height);
+        Ticks ticksY = ticksOf(y, stepY);
+        for (int i = 0; i < ticksY.count; ++i) {
+            double k = ticksY.first + i;
+            if (k != 0) {
+                backend.drawText(formatTick(k * stepY), axisX + 10, static_cast<float>(mapping.toScreenY(k * stepY)), 15, sf::Color::Black);
+            }
+        }
+    }
+
+    // Collects each clipped run, simplifies it and stores its points
+    // relative to the origin.
+    struct StripSink {
+        CurveCache& cache;
+        const PolylineSimplifier& simplifier;
+        double originX, originY;
+        std::vector<double>& runX;
+        std::vector<double>& runY;
+        std::vector<size_t>& keep;
+
+        void begin() {
+            flush();
+        }
+
+        void vertex(double x, double y) {
+            runX.push_back(x);
+            runY.push_back(y);
+        }
+
+        void flush() {
+            if (runX.empty()) {
+                return;
+            }
+            simplifier.simplify(runX.data(), runY.data(), runX.size(), keep);
+            for (size_t index : keep) {
+                cache.pathX.push_back(static_cast<float>(runX[index] - originX));
+                cache.pathY.push_back(static_cast<float>(runY[index] - originY));
+            }
+            cache.runEnds.push_back(cache.pathX.size());
+            cache.clippedVertices += runX.size();
+            cache.vertexCount += keep.size();
+            runX.clear();
+            runY.clear();
+        }
+    };
+    std::vector<double> runX, runY; // reused between rebuilds
+    std::vector<size_t> keptIndices;
+    size_t reportedCacheBytes = 0;  // registered with MemoryBudget
+    PolylineTessellator tessellator;
+
+    static const size_t kClipBlock = 4096;
+
+    // Clips a graph to the window and simplifies it into world-space runs
+    // relative to the origin, a chunk at a time through frame memory.
+    // Samples that are not contiguous (skipped pages) are not joined.
+    void rebuildCurve(const Graph& graph, CurveCache& cache, Range windowX, Range windowY,
+        double originX, double originY, double phaseX) {
+        cache.pathX.clear();
+        cache.pathY.clear();
+        cache.runEnds.clear();
+        cache.clippedVertices = cache.vertexCount = 0;
+        PolylineSimplifier simplifier(mapping.pixelsPerUnitX(), mapping.pixelsPerUnitY(), originX, phaseX);
+        StripSink sink = { cache, simplifier, originX, originY, runX, runY, keptIndices };
+        PolylineClipper clipper(windowX, windowY);
+        size_t previousEnd = 0;
+        // An in-memory series arrives as one chunk, so x values and clip codes are
+        // produced kClipBlock samples at a time into one reused scratch block.
+        double* scratchX = frameArena.allocateArray<double>(kClipBlock);
+        unsigned char* codes = frameArena.allocateArray<unsigned char>(kClipBlock);
+        graph.visitVisibleSamples([&](const SeriesChunk& chunk) {
+            if (previousEnd != chunk.first) {
+                clipper.breakLine();
+            }
+            for (size_t start = 0; start < chunk.count; start += kClipBlock) {
+                size_t n = std::min(chunk.count - start, static_cast<size_t>(kClipBlock));
+                const double* xs = chunk.xs ? chunk.xs + start : scratchX;
+                if (!chunk.xs) {
+                    for (size_t i = 0; i < n; ++i) {
+                        scratchX[i] = chunk.x(start + i);
+                    }
+                }
+                clipper.outcodes(xs, chunk.ys + start, n, codes);
+                clipper.add(xs, chunk.ys + start, codes, n, sink);
+            }
+            previousEnd = chunk.first + chunk.count;
+        }, windowX);
+        sink.flush();
+        cache.pixelsX = mapping.pixelsPerUnitX();
+        cache.pixelsY = mapping.pixelsPerUnitY();
+        cache.phaseX = phaseX;
+        cache.revision = graph.getRevision();
+        cache.window = windowX;
+        cache.windowY = windowY;
+        cache.originX = originX;
+        cache.originY = originY;
+        cache.built = true;
     }
 
-    double evaluate(double x) override {
-        if (type == "sin") {
-            return amplitude * std::sin(frequency * x + phaseShift);
+    // Rebuilds the outline of the cached points at the current scale.
+    void tessellateCurve(CurveCache& cache, const GraphStyle& style) {
+        float scaleX = static_cast<float>(mapping.pixelsPerUnitX()), scaleY = static_cast<float>(mapping.pixelsPerUnitY());
+        cache.outline.clear();
+        size_t start = 0;
+        for (size_t end : cache.runEnds) {
+            tessellator.addRun(cache.pathX.data() + start, cache.pathY.data() + start, end - start,
+                scaleX, scaleY, style, cache.outline);
+            start = end;
         }
-        else if (type == "cos") {
-            return amplitude * std::cos(frequency * x + phaseShift);
+        float left = INFINITY, top = INFINITY, right = -INFINITY, bottom = -INFINITY;
+        for (const sf::Vertex& vertex : cache.outline) {
+            left = std::min(left, vertex.position.x);
+            right = std::max(right, vertex.position.x);
+            top = std::min(top, vertex.position.y);
+            bottom = std::max(bottom, vertex.position.y);
         }
-        return 0.0; // Unknown type
+        cache.localBounds = cache.outline.empty() ? sf::FloatRect() : sf::FloatRect(left, top, right - left, bottom - top);
+        cache.outlineStyle = style;
+        cache.outlineScaleX = mapping.pixelsPerUnitX();
+        cache.outlineScaleY = mapping.pixelsPerUnitY();
     }
 
-    std::string getFormula() override {
-        return "Trigonometric Function";
+    static bool sameRect(const sf::FloatRect& a, const sf::FloatRect& b) {
+        return a.left == b.left && a.top == b.top && a.width == b.width && a.height == b.height;
     }
-};
 
-class ExponentialFunction : public Function {
-private:
-    double base, coefficient;
-public:
-    ExponentialFunction(double coefficient, double base) : coefficient(coefficient), base(base) {}
+    // Re-renders the background layer if its inputs changed. Returns true
+    // if it did, which damages the whole frame.
+    bool updateBackground(const sf::RenderWindow& window) {
+        const CoordinateSystem& cs = plotArea->getCoordinateSystem();
+        sf::Vector2u size = window.getSize();
+        const sf::View& view = window.getView();
+        if (!backgroundAvailable) {
+            return false;
+        }
+        // Drawn without labels while the font was loading: redraw once the
+        // load has finished, whether it succeeded or not
+        bool fontArrived = backgroundAwaitsFont && !screen.isTextPending();
+        if (backgroundValid && !fontArrived && size.x == backgroundSize.x && size.y == backgroundSize.y
+            && view.getSize().x == backgroundViewSize.x && view.getSize().y == backgroundViewSize.y
+            && cs.getXRange().min == backgroundX.min && cs.getXRange().max == backgroundX.max
+            && cs.getYRange().min == backgroundY.min && cs.getYRange().max == backgroundY.max) {
+            return false;
+        }
 
-    double evaluate(double x) override {
-        return coefficient * std::pow(base, x);
-    }
+        if (size.x != backgroundSize.x || size.y != backgroundSize.y) {
+            if (!background) {
+                background.reset(new sf::RenderTexture());
+            }
+            if (!background->create(size.x, size.y)) {
+                std::cerr << "Render texture unavailable, drawing the grid directly" << std::endl;
+                backgroundAvailable = false;
+                return true;
+            }
+            backgroundSize = size;
+        }
+        buildLines(cs);
+        background->setView(view);
+        screen.setTarget(*background);
+        screen.beginScene();
+        screen.clear(sf::Color::White);
+        drawGrid(screen);
+        drawAxes(screen);
+        background->display();
 
-    std::string getFormula() override {
-        return "Exponential Function";
+        backgroundSprite.setTexture(background->getTexture(), true);
+        placeOverView(backgroundSprite, view, size);
+        backgroundValid = true;
+        backgroundAwaitsFont = screen.isTextPending();
+        backgroundViewSize = view.getSize();
+        backgroundX = cs.getXRange();
+        backgroundY = cs.getYRange();
+        return true;
     }
-};
 
-class Graph {
-private:
-    std::vector<Point> points;
-    Function* function;
-public:
-    Graph(Function* func) : function(func) {}
-    std::string serialize() const {
-        std::ostringstream oss;
-        // Здесь вы должны сериализовать данные графика
-        // Например, если у вас есть точки графика:
-        for (const auto& point : points) {
-            oss << point.x << "," << point.y << " "; // Пример формата
+    void drawBackground(sf::RenderTarget& target) {
+        if (backgroundAvailable) {
+            target.draw(backgroundSprite);
+            ++drawCalls;
         }
-        return oss.str();
-    }
-    Graph() {
-        // Инициализация данных графика, если необходимо
-        // Например, можно инициализировать вектор точек
-        points = std::vector<Point>(); // Предполагая, что у вас есть структура Point
-    }
-    void deserialize(const std::string& data) {
-        std::istringstream iss(data);
-        std::string point;
-        points.clear();
-        while (iss >> point) {
-            double x, y;
-            char comma; // Для разделения значений
-            std::istringstream pointStream(point);
-            pointStream >> x >> comma >> y;
-            points.emplace_back(x, y); // Предполагаем, что у вас есть структура Point
+        else {
+            buildLines(plotArea->getCoordinateSystem());
+            screen.setTarget(target);
+            screen.beginScene();
+            screen.clear(sf::Color::White);
+            drawGrid(screen);
+            drawAxes(screen);
         }
     }
-    void generatePoints(Range xRange, int numPoints) {
-        points.clear();
-        double step = (xRange.max - xRange.min) / numPoints;
-        for (int i = 0; i <= numPoints; ++i) {
-            double x = xRange.min + i * step;
-            double y = function->evaluate(x);
-            points.emplace_back(x, y);
+
+    // The curves in drawing order that touch area.
+    void drawCurves(RenderBackend& backend, const sf::FloatRect& area) {
+        for (const CurveCache* curve : drawOrder) {
+            if (curve->bounds.intersects(area)) {
+                backend.drawCurve(curve->geometry());
+            }
         }
     }
 
-    const std::vector<Point>& getPoints() const {
-        return points;
+    // Stretches a window-sized texture over the whole view.
+    static void placeOverView(sf::Sprite& sprite, const sf::View& view, sf::Vector2u size) {
+        sprite.setPosition(view.getCenter().x - view.getSize().x / 2, view.getCenter().y - view.getSize().y / 2);
+        sprite.setScale(view.getSize().x / size.x, view.getSize().y / size.y);
     }
-};
-
-class CoordinateSystem {
-private:
-    Range xRange;
-    Range yRange;
-
-public:
-    CoordinateSystem(Range x, Range y) : xRange(x), yRange(y) {}
 
-    void setRanges(Range newXRange, Range newYRange) {
-        xRange = newXRange;
-        yRange = newYRange;
+    // (Re)creates the persistent frame texture; true if its old content is gone.
+    bool updateFrameTexture(const sf::RenderWindow& window) {
+        sf::Vector2u size = window.getSize();
+        if (!frameAvailable || (size.x == frameSize.x && size.y == frameSize.y)) {
+            return false;
+        }
+        sf::ContextSettings settings;
+        settings.antialiasingLevel = kAntialiasingLevel;
+        if (!frame) {
+            frame.reset(new sf::RenderTexture());
+        }
+        if (!frame->create(size.x, size.y, settings)) {
+            frameAvailable = false;
+            return true;
+        }
+        frameSize = size;
+        frameSprite.setTexture(frame->getTexture(), true);
+        placeOverView(frameSprite, window.getView(), size);
+        return true;
     }
 
-    Range getXRange() const { return xRange; }
-    Range getYRange() const { return yRange; }
-};
-
-class PlotArea {
-private:
-    CoordinateSystem coordinateSystem;
-    std::vector<Graph> graphs;
-public:
-    PlotArea(CoordinateSystem cs) : coordinateSystem(cs) {}
+    // Draws the background and the curves that touch rect, clipped to rect.
+    void repaint(sf::RenderTarget& target, const sf::View& view, sf::Vector2u size, sf::FloatRect rect) {
+        // Snap to whole pixels so neighbouring repaints leave no seams
+        float left = view.getCenter().x - view.getSize().x / 2, top = view.getCenter().y - view.getSize().y / 2;
+        float pixelX = view.getSize().x / size.x, pixelY = view.getSize().y / size.y;
+        float x0 = std::max(0.0f, std::floor((rect.left - left) / pixelX));
+        float y0 = std::max(0.0f, std::floor((rect.top - top) / pixelY));
+        float x1 = std::min(static_cast<float>(size.x), std::ceil((rect.left + rect.width - left) / pixelX));
+        float y1 = std::min(static_cast<float>(size.y), std::ceil((rect.top + rect.height - top) / pixelY));
+        if (x1 <= x0 || y1 <= y0) {
+            return;
+        }
+        sf::FloatRect area(left + x0 * pixelX, top + y0 * pixelY, (x1 - x0) * pixelX, (y1 - y0) * pixelY);
+        sf::View clip(area);
+        clip.setViewport(sf::FloatRect(x0 / size.x, y0 / size.y, (x1 - x0) / size.x, (y1 - y0) / size.y));
+        target.setView(clip);
 
-    void addGraph(Graph graph) {
-        graphs.push_back(graph);
+        drawBackground(target);
+        screen.setTarget(target);
+        drawCurves(screen, area);
+        target.setView(view);
     }
 
-    void clear() {
-        graphs.clear();
-    }
+    // Brings the curves up to date with the mapping and collects the
+    // visible ones in drawing order. A curve that changed or moved damages
+    // where it was and where it is now.
+    void updateCurves() {
+        const CoordinateSystem& cs = plotArea->getCoordinateSystem();
+        Range visibleX = cs.getXRange(), visibleY = cs.getYRange();
+        drawOrder.clear();
+        for (const auto& slot : plotArea->getGraphs()) {
+            const Graph& graph = *slot.graph;
+            if (!graph.isVisible()) {
+                continue;
+            }
+            // A live graph scrolls: its newest sample sits at the right edge
+            double shiftX = 0;
+            if (graph.isLive()) {
+                if (graph.getPointCount() == 0) {
+                    continue;
+                }
+                shiftX = visibleX.max - graph.getLiveSeries()->latest().x;
+            }
+            else if (!graph.intersects(visibleX, visibleY)) {
+                continue;
+            }
+            Range dataX(visibleX.min - shiftX, visibleX.max - shiftX);
+            double spanX = dataX.max - dataX.min, spanY = visibleY.max - visibleY.min;
+            double centerX = (dataX.min + dataX.max) / 2, centerY = (visibleY.min + visibleY.max) / 2;
 
-    const std::vector<Graph>& getGraphs() const {
-        return graphs;
-    }
-    void saveToFile(const std::string& filename) {
-        std::ofstream outFile(filename);
-        for (const auto& graph : graphs) {
-            outFile << graph.serialize() << std::endl; // Сохраняем каждый график
+            // Paged graphs only read the pages under the window; ask for the
+            // neighbours now so panning finds them resident.
+            graph.prefetch(dataX);
+
+            auto found = curves.find(slot.handle.id);
+            bool isNew = found == curves.end();
+            CurveCache& cache = isNew ? curves[slot.handle.id] : found->second;
+            cache.used = true;
+            // The simplified points only match the screen at the column
+            // phase they were made for: a pan by whole columns is a plain
+            // translation, any other pan re-simplifies.
+            double phase = PolylineSimplifier::phaseOf(mapping.toScreenX(cache.originX + shiftX));
+            double phaseShift = std::fabs(phase - cache.phaseX);
+            phaseShift = std::min(phaseShift, 1.0 / PolylineSimplifier::kColumnsPerPixel - phaseShift);
+            bool stale = !cache.built || cache.revision != graph.getRevision() || phaseShift > kPhaseTolerance
+                || std::fabs(centerX - cache.originX) > kRebaseRatio * spanX
+                || std::fabs(centerY - cache.originY) > kRebaseRatio * spanY
+                || dataX.min < cache.window.min || dataX.max > cache.window.max
+                || visibleY.min < cache.windowY.min || visibleY.max > cache.windowY.max
+                || mapping.pixelsPerUnitX() > cache.pixelsX * 1.25 || mapping.pixelsPerUnitY() > cache.pixelsY * 1.25;
+            if (stale) {
+                rebuildCurve(graph, cache, Range(dataX.min - spanX, dataX.max + spanX),
+                    Range(visibleY.min - spanY, visibleY.max + spanY), centerX, centerY,
+                    PolylineSimplifier::phaseOf(mapping.toScreenX(centerX + shiftX)));
+            }
+            bool restyled = stale || !(cache.outlineStyle == graph.getStyle())
+                || cache.outlineScaleX != mapping.pixelsPerUnitX() || cache.outlineScaleY != mapping.pixelsPerUnitY();
+            if (restyled) {
+                tessellateCurve(cache, graph.getStyle());
+            }
+            cache.transform = mapping.transformFrom(cache.originX + shiftX, cache.originY);
+            sf::FloatRect area = cache.transform.apply(cache.localBounds);
+            area = sf::FloatRect(area.left - 1, area.top - 1, area.width + 2, area.height + 2);
+            if (restyled || isNew || !cache.drawn || !sameRect(area, cache.bounds)) {
+                if (cache.drawn) {
+                    damage.add(cache.bounds);
+                }
+                damage.add(area);
+            }
+            cache.bounds = area;
+            cache.drawn = true;
+            drawOrder.push_back(&cache);
         }
-        outFile.close();
-    }
-    void loadFromFile(const std::string& filename) {
-        std::ifstream inFile(filename);
-        std::string line;
-        clear(); // Очищаем текущие графики перед загрузкой
-        while (std::getline(inFile, line)) {
-            Graph graph;
-            graph.deserialize(line); // Загружаем график из строки
-            addGraph(graph);
+
+        // Forget the curves of graphs that were removed, hidden or off
+        // screen; the area they covered needs repainting
+        size_t cacheBytes = (runX.capacity() + runY.capacity()) * sizeof(double) + keptIndices.capacity() * sizeof(size_t);
+        for (auto it = curves.begin(); it != curves.end();) {
+            if (it->second.used) {
+                it->second.used = false;
+                cacheBytes += it->second.memoryBytes();
+                ++it;
+            }
+            else {
+                damage.add(it->second.bounds);
+                it = curves.erase(it);
+            }
         }
-        inFile.close();
+        MemoryBudget::instance().addCacheBytes(cacheBytes);
+        MemoryBudget::instance().removeCacheBytes(reportedCacheBytes);
+        reportedCacheBytes = cacheBytes;
     }
-};
-
-class GraphPlotter {
-private:
-    PlotArea* plotArea;
 
-    void drawAxes(sf::RenderWindow& window) {
-        // Draw X axis
-        sf::Vertex xAxis[] = {
-            sf::Vertex(sf::Vector2f(0, 300), sf::Color::Black), // Start of X axis
-            sf::Vertex(sf::Vector2f(800, 300), sf::Color::Black) // End of X axis
-        };
-        window.draw(xAxis, 2, sf::Lines);
+public:
+    // Multisampling for the window and the frame texture; smooths the
+    // curve outlines.
+    static const unsigned kAntialiasingLevel = 8;
 
-        // Draw Y axis
-        sf::Vertex yAxis[] = {
-            sf::Vertex(sf::Vector2f(400, 0), sf::Color::Black), // Start of Y axis
-            sf::Vertex(sf::Vector2f(400,            600), sf::Color::Black) // End of Y axis
-        };
-        window.draw(yAxis, 2, sf::Lines);
+    GraphPlotter(PlotArea* area) : plotArea(area) {}
 
-        // Label the axes
-        sf::Font font;
-        font.loadFromFile("arial.ttf"); // Ensure the font is available
+    ~GraphPlotter() {
+        MemoryBudget::instance().removeCacheBytes(reportedCacheBytes);
+    }
 
-        sf::Text xLabel("X", font, 20);
-        xLabel.setPosition(780, 310); // Position for X axis label
-        xLabel.setFillColor(sf::Color::Black); // Set text color to black
-        window.draw(xLabel);
+    // Brings the frame up to date. Returns false, having drawn nothing, if
+    // nothing on screen changed; display() must then be skipped too.
+    bool plot(sf::RenderWindow& window) {
+        drawCalls = 0;
+        screen.resetDrawCalls();
 
-        sf::Text yLabel("Y", font, 20);
-        yLabel.setPosition(420, 10); // Position for Y axis label
-        yLabel.setFillColor(sf::Color::Black); // Set text color to black
-        window.draw(yLabel);
-    }
+        // Sample whatever became stale and is actually going to be drawn
+        plotArea->materializeVisible();
 
-    void drawGrid(sf::RenderWindow& window) {
-        const int step = 40; // Increase step to 40 pixels
-        sf::Font font;
+        // The mapping follows the coordinate system and the view
+        const CoordinateSystem& cs = plotArea->getCoordinateSystem();
+        const sf::View& currentView = window.getView();
+        viewArea = sf::FloatRect(currentView.getCenter().x - currentView.getSize().x / 2,
+            currentView.getCenter().y - currentView.getSize().y / 2, currentView.getSize().x, currentView.getSize().y);
+        mapping = ScreenMapping(cs.getXRange(), cs.getYRange(), viewArea);
 
-        if (!font.loadFromFile("arial.ttf")) {
-            std::cerr << "Error loading font!" << std::endl;
-            return; // Exit if font is not loaded
+        if (updateBackground(window) | updateFrameTexture(window)) {
+            damage.addAll();
         }
 
-        for (int i = 0; i <= 800; i += step) {
-            sf::Vertex line[] = {
-                sf::Vertex(sf::Vector2f(i, 0), sf::Color(200, 200, 200)),
-                sf::Vertex(sf::Vector2f(i, 600), sf::Color(200, 200, 200))
-            };
-            window.draw(line, 2, sf::Lines);
+        updateCurves();
 
-            // Labels for X axis
-            if (i != 400) { // Avoid overlap on Y axis
-                sf::Text xValue(std::to_string((i - 400) / 20), font, 15);
-                xValue.setPosition(i, 310); // Position for label
-                xValue.setFillColor(sf::Color::Black);
-                window.draw(xValue);
-            }
+        if (!backgroundAvailable && !damage.empty()) {
+            damage.addAll(); // the direct grid path clears the whole target
         }
+        if (damage.empty()) {
+            frameArena.reset(false);
+            ++skippedFrames;
+            return false;
+        }
+        ++repaintedFrames;
 
-        for (int i = 0; i <= 600; i += step) {
-            sf::Vertex line[] = {
-                sf::Vertex(sf::Vector2f(0, i), sf::Color(200, 200, 200)),
-                sf::Vertex(sf::Vector2f(800, i), sf::Color(200, 200, 200))
-            };
-            window.draw(line, 2, sf::Lines);
-
-            // Labels for Y axis
-            if (i != 300) { // Avoid overlap on X axis
-                sf::Text yValue(std::to_string((300 - i) / 20), font, 15);
-                yValue.setPosition(410, i); // Position for label
-                yValue.setFillColor(sf::Color::Black);
-                window.draw(yValue);
+        const sf::View& view = window.getView();
+        sf::Vector2u size = window.getSize();
+        sf::FloatRect whole(view.getCenter().x - view.getSize().x / 2, view.getCenter().y - view.getSize().y / 2,
+            view.getSize().x, view.getSize().y);
+        if (frameAvailable && frame) {
+            frame->setView(view);
+            if (damage.isFull()) {
+                repaint(*frame, view, size, whole);
             }
+            else {
+                for (const sf::FloatRect& rect : damage.getRects()) {
+                    repaint(*frame, view, size, rect);
+                }
+            }
+            frame->display();
+            window.clear(sf::Color::White);
+            window.draw(frameSprite);
+            ++drawCalls;
+        }
+        else {
+            window.clear(sf::Color::White);
+            repaint(window, view, size, whole);
         }
+        damage.clear();
+        return true;
     }
 
-public:
-    GraphPlotter(PlotArea* area) : plotArea(area) {}
+    // Draws the whole scene for a width x height target through any
+    // backend, with no window involved; used for headless rendering.
+    void render(RenderBackend& backend, unsigned width, unsigned height) {
+        plotArea->materializeVisible();
+        const CoordinateSystem& cs = plotArea->getCoordinateSystem();
+        viewArea = sf::FloatRect(0, 0, static_cast<float>(width), static_cast<float>(height));
+        mapping = ScreenMapping(cs.getXRange(), cs.getYRange(), viewArea);
+        updateCurves();
+        damage.addAll(); // the window, if any, has to catch up with the new curves
 
-    void plot(sf::RenderWindow& window) {
-        // First draw the grid
-        drawGrid(window);
+        buildLines(cs);
+        backend.clear(sf::Color::White);
+        drawGrid(backend);
+        drawAxes(backend);
+        drawCurves(backend, viewArea);
+        backend.endScene();
+        frameArena.reset();
+    }
 
-        // Then draw the axes
-        drawAxes(window);
+    // Repaints everything next frame, e.g. after the window was resized or
+    // uncovered.
+    void invalidate() {
+        damage.addAll();
+    }
 
-        // Then draw the graphs
-        for (const auto& graph : plotArea->getGraphs()) {
-            const auto& points = graph.getPoints();
-            for (size_t i = 1; i < points.size(); ++i) {
-                sf::Vertex line[] = {
-                    sf::Vertex(sf::Vector2f(points[i - 1].x * 20 + 400, -points[i - 1].y * 20 + 300), sf::Color::Black),
-                    sf::Vertex(sf::Vector2f(points[i].x * 20 + 400, -points[i].y * 20 + 300), sf::Color::Black)
-                };
-                window.draw(line, 2, sf::Lines);
+    // Points drawn per graph against what clipping left of its samples.
+    void reportSimplification(std::ostream& out) const {
+        for (const auto& slot : plotArea->getGraphs()) {
+            auto found = curves.find(slot.handle.id);
+            if (found == curves.end() || found->second.vertexCount == 0) {
+                continue;
             }
+            const CurveCache& cache = found->second;
+            out << "  график " << slot.handle.id << ": " << cache.clippedVertices << " -> " << cache.vertexCount
+                << " вершин (в " << static_cast<double>(cache.clippedVertices) / cache.vertexCount << " раз меньше)\n";
         }
     }
 
+    size_t getRepaintedFrames() const { return repaintedFrames; }
+    size_t getSkippedFrames() const { return skippedFrames; }
+
+    // Presents the frame and releases its temporaries.
+    void display(sf::RenderWindow& window) {
+        window.display();
+        frameArena.reset();
+        lastDrawCalls = drawCalls + screen.getDrawCalls();
+    }
+
+    size_t getLastDrawCalls() const {
+        return lastDrawCalls;
+    }
+
+    const FrameArena::Stats& getLastFrameStats() const {
+        return frameArena.getLastFrameStats();
+    }
+
     void clear() {
         plotArea->clear();
     }
 };
 
+// Пункт меню вместе с введёнными параметрами
+struct Command {
+    int choice = 0;
+    double values[4] = { 0, 0, 0, 0 };
+    std::string filename;
+};
+
 class UserInterface {
+private:
+    struct CommandQueue {
+        std::mutex mutex;
+        std::deque<Command> commands;
+    };
+    std::shared_ptr<CommandQueue> queue = std::make_shared<CommandQueue>();
+
 public:
     void showMenu() {
         std::cout << "1. Построить многочлен\n";
@@ -298,13 +4695,27 @@ public:
         std::cout << "6. Сохранить графики в файл\n"; // Новый пункт меню
         std::cout << "7. Загрузить графики из файла\n"; // Новый пункт меню
         std::cout << "8. Выход\n";
+        std::cout << "9. Статистика\n";
+        std::cout << "10. Открыть файл трассы\n";
+        std::cout << "11. Живой сигнал (демо)\n";
+        std::cout << "12. Толщина и цвет линий\n";
+    }
+
+    // Asks again until min < max; stops early if the input ends.
+    void getRange(const char* prompt, double& min, double& max) {
+        while (true) {
+            std::cout << prompt;
+            std::cin >> min >> max;
+            if (!std::cin || (min < max && std::isfinite(max - min))) {
+                return;
+            }
+            std::cout << "Минимум должен быть меньше максимума, попробуйте ещё раз.\n";
+        }
     }
 
     void getNewRange(double& xMin, double& xMax, double& yMin, double& yMax) {
-        std::cout << "Введите новый диапазон по оси X (min max): ";
-        std::cin >> xMin >> xMax;
-        std::cout << "Введите новый диапазон по оси Y (min max): ";
-        std::cin >> yMin >> yMax;
+        getRange("Введите новый диапазон по оси X (min max): ", xMin, xMax);
+        getRange("Введите новый диапазон по оси Y (min max): ", yMin, yMax);
     }
 
     void getPolynomialParameters(double& a, double& b, double& c) {
@@ -321,12 +4732,363 @@ public:
         std::cout << "Введите параметры показательной функции (коэффициент, основание): ";
         std::cin >> coefficient >> base;
     }
+
+    void getStyleParameters(double& width, double& red, double& green, double& blue) {
+        std::cout << "Введите толщину линии в пикселях и цвет (R G B, 0-255): ";
+        std::cin >> width >> red >> green >> blue;
+    }
+
+    void getFilename(const std::string& prompt, std::string& filename) {
+        std::cout << prompt;
+        std::cin >> filename;
+    }
+
+    // Shows the menu and blocks until a choice and its parameters are read.
+    Command readCommand() {
+        Command command;
+        showMenu();
+        if (!(std::cin >> command.choice)) {
+            if (std::cin.eof()) {
+                command.choice = 8; // ввод закрыт - выходим
+                return command;
+            }
+            std::cin.clear();
+            std::cin.ignore(1024, '\n');
+            command.choice = 0;
+            return command;
+        }
+        double* v = command.values;
+        switch (command.choice) {
+        case 1: getPolynomialParameters(v[0], v[1], v[2]); break;
+        case 2: getTrigonometricParameters(v[0], v[1], v[2]); break;
+        case 3: getExponentialParameters(v[0], v[1]); break;
+        case 4: getNewRange(v[0], v[1], v[2], v[3]); break;
+        case 6: getFilename("Введите имя файла для сохранения: ", command.filename); break;
+        case 7: getFilename("Введите имя файла для загрузки: ", command.filename); break;
+        case 10: getFilename("Введите имя файла трассы: ", command.filename); break;
+        case 12: getStyleParameters(v[0], v[1], v[2], v[3]); break;
+        }
+        return command;
+    }
+
+    // Reads the console on a background thread so that the window keeps
+    // handling events and redrawing while std::cin blocks.
+    void startInputThread() {
+        std::shared_ptr<CommandQueue> target = queue;
+        std::thread([this, target]() {
+            while (true) {
+                Command command = readCommand();
+                {
+                    std::lock_guard<std::mutex> lock(target->mutex);
+                    target->commands.push_back(command);
+                }
+                if (command.choice == 8) {
+                    return;
+                }
+            }
+        }).detach();
+    }
+
+    bool pollCommand(Command& command) {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (queue->commands.empty()) {
+            return false;
+        }
+        command = queue->commands.front();
+        queue->commands.pop_front();
+        return true;
+    }
 };
 
-int main() {
+// Замеры производительности, запуск: ConsoleApplication7 --bench
+void benchmarkSampling() {
+    // Degree-15 polynomial: pow() per term makes every sample expensive.
+    Graph graph(std::make_shared<PolynomialFunction>(std::vector<double>(16, 0.5)));
+    const int numPoints = 1000000;
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "generatePoints, " << numPoints << " samples\n";
+    double singleThreadMs = 0;
+    for (unsigned threads = 1; threads <= maxThreads; ++threads) {
+        // The calling thread helps while waiting, so threads - 1 workers
+        // give exactly `threads` threads sampling.
+        TaskScheduler scheduler(threads - 1);
+        auto start = std::chrono::steady_clock::now();
+        graph.generatePoints(Range(-10, 10), numPoints, scheduler);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if (threads == 1) {
+            singleThreadMs = elapsed.count();
+        }
+        std::cout << "  threads=" << threads << "  " << elapsed.count() << " ms"
+            << "  speedup=" << singleThreadMs / elapsed.count() << "\n";
+        scheduler.reportUtilization(std::cout);
+    }
+}
+
+template <typename Kernel>
+double timeMs(int repeats, const Kernel& kernel) {
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        kernel();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / repeats;
+}
+
+// Array of structs (std::vector<Point>) against SampleSeries for the
+// bounds reduction and the world-to-screen transform.
+void benchmarkSeriesLayout() {
+    const size_t n = 4000000;
+    const int repeats = 20;
+    std::vector<Point> aos(n);
+    SampleSeries soa;
+    soa.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        double x = i * 0.001, y = std::sin(x);
+        aos[i] = Point(x, y);
+        soa.xData()[i] = x;
+        soa.yData()[i] = y;
+    }
+    std::vector<float> screenX(n), screenY(n);
+    double sink = 0;
+
+    double aosMinMax = timeMs(repeats, [&]() {
+        double lo = INFINITY, hi = -INFINITY;
+        for (const auto& point : aos) {
+            if (point.y < lo) lo = point.y;
+            if (point.y > hi) hi = point.y;
+        }
+        sink += lo + hi;
+    });
+    double soaMinMax = timeMs(repeats, [&]() {
+        Range bounds = minMaxKernel(soa.yData(), n);
+        sink += bounds.min + bounds.max;
+    });
+    double aosTransform = timeMs(repeats, [&]() {
+        for (size_t i = 0; i < n; ++i) {
+            screenX[i] = static_cast<float>(aos[i].x * 20 + 400);
+            screenY[i] = static_cast<float>(aos[i].y * -20 + 300);
+        }
+    });
+    double soaTransform = timeMs(repeats, [&]() {
+        affineTransformKernel(soa.xData(), n, 20, 400, screenX.data());
+        affineTransformKernel(soa.yData(), n, -20, 300, screenY.data());
+    });
+
+    std::cout << "Series layout, " << n << " points (AoS vs SoA)\n"
+        << "  min/max:   " << aosMinMax << " ms vs " << soaMinMax << " ms\n"
+        << "  transform: " << aosTransform << " ms vs " << soaTransform << " ms\n";
+    if (sink == 42) {
+        std::cout << ""; // keeps the reductions from being optimized away
+    }
+}
+
+// Same work on regular and on 2 MB pages: parallel sampling (first touch),
+// a streaming min/max and a TLB-bound strided gather.
+void benchmarkLargePages() {
+    const int n = 1 << 25; // 256 MB of y values
+    const int repeats = 5;
+    PolynomialFunction function(std::vector<double>{ 1, 0.5, 0.25 });
+    bool wasEnabled = LargePages::isEnabled();
+    std::cout << "Large pages, " << n << " points\n";
+    for (int large = 0; large < 2; ++large) {
+        LargePages::setEnabled(large != 0);
+        SampleSeries series;
+        auto start = std::chrono::steady_clock::now();
+        Graph::sampleFunction(&function, Range(-10, 10), n - 1, series, CancellationToken());
+        std::chrono::duration<double, std::milli> sampling = std::chrono::steady_clock::now() - start;
+
+        const double* ys = series.yData();
+        double sink = 0;
+        double minMax = timeMs(repeats, [&]() {
+            Range bounds = minMaxKernel(ys, n);
+            sink += bounds.min + bounds.max;
+        });
+        double gather = timeMs(repeats, [&]() {
+            size_t index = 0;
+            for (int i = 0; i < (1 << 22); ++i) {
+                sink += ys[index];
+                index = (index + 4099 * 8 + 1) & (n - 1); // a new 4 KB page every read
+            }
+        });
+        std::cout << (large ? "  2 MB pages" : "  regular   ")
+            << (large && !series.usesLargePages() ? " (unavailable, fell back)" : "")
+            << ": sampling " << sampling.count() << " ms, min/max " << minMax
+            << " ms, gather " << gather << " ms\n";
+        if (sink == 42) {
+            std::cout << "";
+        }
+    }
+    LargePages::setEnabled(wasEnabled);
+}
+
+void benchmarkLiveIngest() {
+    const size_t n = 20000000;
+    std::shared_ptr<LiveSeries> series = std::make_shared<LiveSeries>(1u << 20);
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer([series]() {
+        for (size_t i = 0; i < n; ++i) {
+            double x = i * 0.001;
+            while (!series->push(x, x)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    while (series->getTotal() < n) {
+        if (series->drain() == 0) {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Live ingest, " << n << " points through the SPSC ring\n"
+        << "  " << n / elapsed.count() / 1e6 << " M points/s, " << series->getDropped()
+        << " pushes found the queue full\n";
+}
+
+// Software rendering of a 4K frame with many curves, by thread count.
+void benchmarkSoftwareRaster() {
+    const unsigned width = 3840, height = 2160;
+    const int graphCount = 200;
+    CoordinateSystem coordinateSystem(Range(-10, 10), Range(-10, 10));
+    PlotArea plotArea(coordinateSystem);
+    for (int i = 0; i < graphCount; ++i) {
+        Graph graph(std::make_shared<TrigonometricFunction>("sin", 1 + i * 0.04, 1 + i * 0.01, i * 0.1));
+        graph.generatePoints(coordinateSystem.getXRange(), 20000);
+        plotArea.addGraph(std::move(graph));
+    }
+    GraphPlotter graphPlotter(&plotArea);
+    SoftwareRasterizer raster;
+    raster.resize(width, height);
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "Software raster, " << width << "x" << height << ", " << graphCount << " graphs\n";
+    double singleThreadMs = 0;
+    for (unsigned threads = 1; threads <= maxThreads; ++threads) {
+        TaskScheduler scheduler(threads - 1);
+        SoftwareBackend backend(raster, scheduler);
+        graphPlotter.render(backend, width, height); // builds the curves once
+        double elapsed = timeMs(5, [&]() { graphPlotter.render(backend, width, height); });
+        if (threads == 1) {
+            singleThreadMs = elapsed;
+        }
+        std::cout << "  threads=" << threads << "  " << elapsed << " ms"
+            << "  speedup=" << singleThreadMs / elapsed << "\n";
+    }
+}
+
+int runBenchmarks() {
+    benchmarkSampling();
+    benchmarkSeriesLayout();
+    benchmarkLargePages();
+    benchmarkLiveIngest();
+    benchmarkSoftwareRaster();
+    return 0;
+}
+
+// Демонстрационный источник: шумная синусоида, 2000 точек в секунду.
+// Поток сам завершается, когда график удалён.
+std::shared_ptr<LiveSeries> startLiveDemo() {
+    std::shared_ptr<LiveSeries> series = std::make_shared<LiveSeries>(8000);
+    std::weak_ptr<LiveSeries> target = series;
+    std::thread([target]() {
+        auto start = std::chrono::steady_clock::now();
+        size_t produced = 0;
+        while (true) {
+            std::shared_ptr<LiveSeries> live = target.lock();
+            if (!live) {
+                return;
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            for (size_t due = static_cast<size_t>(elapsed.count() * 2000); produced < due; ++produced) {
+                double t = produced / 2000.0;
+                live->push(t * 10, 5 * std::sin(t * 3) + 0.5 * std::sin(t * 170));
+            }
+            live.reset();
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }).detach();
+    return series;
+}
+
+// Графики, с которых начинается работа
+void addStartupGraphs(PlotArea& plotArea, Range xRange) {
+    // Создание и добавление функций (функцией владеет график)
+    Graph polyGraph(std::make_shared<PolynomialFunction>(std::vector<double>{ 1, 0, -1 })); // x^2 - 1
+    polyGraph.generatePoints(xRange, 100);
+    plotArea.addGraph(std::move(polyGraph));
+
+    Graph sinGraph(std::make_shared<TrigonometricFunction>("sin", 1.0, 1.0, 0.0)); // sin(x)
+    sinGraph.generatePoints(xRange, 100);
+    plotArea.addGraph(std::move(sinGraph));
+}
+
+// Рисует графики программным растеризатором и сохраняет картинку; не нужны
+// ни окно, ни видеокарта.
+int renderHeadless(const std::string& filename, unsigned width, unsigned height) {
+    Range xRange(-10, 10);
+    Range yRange(-10, 10);
+    CoordinateSystem coordinateSystem(xRange, yRange);
+    PlotArea plotArea(coordinateSystem);
+    GraphPlotter graphPlotter(&plotArea);
+    addStartupGraphs(plotArea, xRange);
+
+    SoftwareRasterizer raster;
+    raster.resize(width, height);
+    SoftwareBackend backend(raster);
+    auto start = std::chrono::steady_clock::now();
+    graphPlotter.render(backend, width, height);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Кадр " << width << "x" << height << " нарисован за " << elapsed.count() << " мс\n";
+
+    sf::Image image;
+    image.create(width, height, raster.getPixels());
+    if (!image.saveToFile(filename)) {
+        std::cerr << "Error saving image " << filename << "!" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
     setlocale(LC_ALL, "Rus");
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        return runBenchmarks();
+    }
+    // --memory-budget <МБ>: предел памяти под точки графиков
+    // --huge-pages: большие буферы точек на страницах по 2 МБ
+    // --spill-dir <папка>: куда выгружать точки сверх предела памяти
+    // --headless <файл.png> [ширина высота]: картинка без окна
+    std::string headlessFile;
+    unsigned headlessWidth = 1920, headlessHeight = 1080;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--memory-budget" && i + 1 < argc) {
+            MemoryBudget::instance().setBudget(static_cast<size_t>(std::atof(argv[i + 1])) << 20);
+        }
+        else if (std::string(argv[i]) == "--huge-pages") {
+            LargePages::setEnabled(true);
+        }
+        else if (std::string(argv[i]) == "--spill-dir" && i + 1 < argc) {
+            MemoryBudget::instance().setSpillDirectory(argv[i + 1]);
+        }
+        else if (std::string(argv[i]) == "--headless" && i + 1 < argc) {
+            headlessFile = argv[i + 1];
+            if (i + 3 < argc && std::atoi(argv[i + 2]) > 0 && std::atoi(argv[i + 3]) > 0) {
+                headlessWidth = static_cast<unsigned>(std::atoi(argv[i + 2]));
+                headlessHeight = static_cast<unsigned>(std::atoi(argv[i + 3]));
+            }
+        }
+    }
+    if (!headlessFile.empty()) {
+        return renderHeadless(headlessFile, headlessWidth, headlessHeight);
+    }
+    // Шрифт читается в фоне, пока создаётся окно
+    ResourceManager::instance().preloadFont("arial.ttf");
+
     // Инициализация SFML и создание окна
-    sf::RenderWindow window(sf::VideoMode(800, 600), "Graph Plotter");
+    sf::ContextSettings settings;
+    settings.antialiasingLevel = GraphPlotter::kAntialiasingLevel;
+    sf::RenderWindow window(sf::VideoMode(800, 600), "Graph Plotter", sf::Style::Default, settings);
 
     // Создание диапазонов
     Range xRange(-10, 10);
@@ -334,19 +5096,11 @@ int main() {
     CoordinateSystem coordinateSystem(xRange, yRange);
     PlotArea plotArea(coordinateSystem);
     GraphPlotter graphPlotter(&plotArea);
-
-    // Создание и добавление функций
-    PolynomialFunction polyFunc({ 1, 0, -1 }); // x^2 - 1
-    Graph polyGraph(&polyFunc);
-    polyGraph.generatePoints(xRange, 100);
-    plotArea.addGraph(polyGraph);
-
-    TrigonometricFunction sinFunc("sin", 1.0, 1.0, 0.0); // sin(x)
-    Graph sinGraph(&sinFunc);
-    sinGraph.generatePoints(xRange, 100);
-    plotArea.addGraph(sinGraph);
+    addStartupGraphs(plotArea, xRange);
 
     UserInterface ui;
+    ui.startInputThread();
+    window.setFramerateLimit(60);
 
     // Основной цикл
     while (window.isOpen()) {
@@ -354,98 +5108,128 @@ int main() {
         while (window.pollEvent(event)) {
             if (event.type == sf::Event::Closed)
                 window.close();
+            else if (event.type == sf::Event::Resized) {
+                // Вид растёт вместе с окном, а не растягивается
+                window.setView(sf::View(sf::FloatRect(0, 0, static_cast<float>(event.size.width),
+                    static_cast<float>(event.size.height))));
+                graphPlotter.invalidate();
+            }
+            else if (event.type == sf::Event::GainedFocus)
+                graphPlotter.invalidate();
         }
 
-        // Очистка окна
-        window.clear(sf::Color::White);
-
-        // Отрисовка графиков
-        graphPlotter.plot(window);
+        // Выполнить команды, введённые в консоли
+        Command command;
+        while (window.isOpen() && ui.pollCommand(command)) {
+            const double* v = command.values;
+            switch (command.choice) {
+            case 1: // Polynomial function
+            {
+                Graph polyGraph(std::make_shared<PolynomialFunction>(std::vector<double>{ v[0], v[1], v[2] }));
+                polyGraph.generatePoints(coordinateSystem.getXRange(), 100);
+                plotArea.clear();
+                plotArea.addGraph(std::move(polyGraph));
+                break;
+            }
+            case 2: // Trigonometric function
+            {
+                Graph sinGraph(std::make_shared<TrigonometricFunction>("sin", v[0], v[1], v[2]));
+                sinGraph.generatePoints(coordinateSystem.getXRange(), 100);
+                plotArea.clear();
+                plotArea.addGraph(std::move(sinGraph));
+                break;
+            }
+            case 3: // Exponential function
+            {
+                Graph expGraph(std::make_shared<ExponentialFunction>(v[0], v[1]));
+                expGraph.generatePoints(coordinateSystem.getXRange(), 100);
+                plotArea.clear();
+                plotArea.addGraph(std::move(expGraph));
+                break;
+            }
+            case 4: // Change range
+            {
+                if (!(v[0] < v[1]) || !(v[2] < v[3])) {
+                    std::cerr << "Invalid range: min must be less than max" << std::endl;
+                    break;
+                }
+                coordinateSystem.setRanges(Range(v[0], v[1]), Range(v[2], v[3]));
 
-        // Отображение содержимого окна
-        window.display();
+                // Пересчитываем показанные графики; старые точки остаются
+                // на экране, пока новые считаются в фоне
+                plotArea.regenerateAsync(coordinateSystem.getXRange(), coordinateSystem.getYRange());
+                break;
+            }
+            case 5: // Clear graphs
+                graphPlotter.clear(); // Очищаем графики
+                plotArea.clear(); // Также очищаем данные в plotArea
+                break;
+            case 6: // Сохранить графики
+                plotArea.saveToFile(command.filename);
+                std::cout << "Графики сохранены в файл " << command.filename << ".\n";
+                break;
+            case 7: // Загрузить графики
+                plotArea.loadFromFile(command.filename);
+                std::cout << "Графики загружены из файла " << command.filename << ".\n";
+                break;
+            case 8: // Выход
+                window.close();
+                break;
+            case 9: // Статистика
+            {
+                std::cout << "Загрузка потоков планировщика:\n";
+                TaskScheduler::instance().reportUtilization(std::cout);
+                const FrameArena::Stats& frame = graphPlotter.getLastFrameStats();
+                std::cout << "Последний кадр: " << frame.allocations << " выделений в арене ("
+                    << frame.bytes << " байт), " << frame.heapAllocations << " из кучи, "
+                    << graphPlotter.getLastDrawCalls() << " вызовов отрисовки\n";
+                std::cout << "Кадров перерисовано: " << graphPlotter.getRepaintedFrames()
+                    << ", пропущено: " << graphPlotter.getSkippedFrames() << "\n";
+                std::cout << "Упрощение линий:\n";
+                graphPlotter.reportSimplification(std::cout);
+                std::cout << "Память:\n";
+                plotArea.reportMemory(std::cout);
+                break;
+            }
+            case 10: // Открыть файл трассы
+                if (plotArea.addPagedGraph(command.filename).isValid()) {
+                    std::cout << "Трасса " << command.filename << " открыта.\n";
+                }
+                break;
+            case 11: // Живой сигнал
+                plotArea.addLiveGraph(startLiveDemo());
+                break;
+            case 12: // Стиль линий всех графиков
+            {
+                GraphStyle style;
+                style.width = static_cast<float>(std::max(0.5, std::min(v[0], 50.0)));
+                style.color = sf::Color(static_cast<sf::Uint8>(std::max(0.0, std::min(v[1], 255.0))),
+                    static_cast<sf::Uint8>(std::max(0.0, std::min(v[2], 255.0))),
+                    static_cast<sf::Uint8>(std::max(0.0, std::min(v[3], 255.0))));
+                for (const auto& slot : plotArea.getGraphs()) {
+                    plotArea.setGraphStyle(slot.handle, style);
+                }
+                break;
+            }
+                // Обработка других случаев...
+            default:
+                std::cout << "Неверный выбор. Пожалуйста, попробуйте снова.\n";
+                break;
+            }
+        }
 
-        // Показать меню и получить ввод пользователя
-        ui.showMenu();
-        int choice;
-        std::cin >> choice;
+        // Забрать точки, досчитанные в фоне
+        plotArea.update();
+        plotArea.enforceMemoryBudget();
 
-        switch (choice) {
-        case 1: // Polynomial function
-        {
-            double a, b, c;
-            ui.getPolynomialParameters(a, b, c);
-            polyFunc = PolynomialFunction({ a, b, c });
-            polyGraph.generatePoints(coordinateSystem.getXRange(), 100);
-            plotArea.clear();
-            plotArea.addGraph(polyGraph);
-            break;
-        }
-        case 2: // Trigonometric function
-        {
-            double amplitude, frequency, phase;
-            ui.getTrigonometricParameters(amplitude, frequency, phase);
-            sinFunc = TrigonometricFunction("sin", amplitude, frequency, phase);
-            sinGraph.generatePoints(coordinateSystem.getXRange(), 100);
-            plotArea.clear();
-            plotArea.addGraph(sinGraph);
-            break;
-        }
-        case 3: // Exponential function
-        {
-            double coefficient, base;
-            ui.getExponentialParameters(coefficient, base);
-            ExponentialFunction expFunc(coefficient, base);
-            Graph expGraph(&expFunc);
-            expGraph.generatePoints(coordinateSystem.getXRange(), 100);
-            plotArea.clear();
-            plotArea.addGraph(expGraph);
-            break;
-        }
-        case 4: // Change range
-        {
-            double xMin, xMax, yMin, yMax;
-            ui.getNewRange(xMin, xMax, yMin, yMax);
-            coordinateSystem.setRanges(Range(xMin, xMax), Range(yMin, yMax));
-            polyGraph.generatePoints(coordinateSystem.getXRange(), 100);
-            sinGraph.generatePoints(coordinateSystem.getXRange(), 100);
-
-            plotArea.clear();
-            plotArea.addGraph(polyGraph);
-            plotArea.addGraph(sinGraph);
-            break;
-        }
-        case 5: // Clear graphs
-            graphPlotter.clear(); // Очищаем графики
-            plotArea.clear(); // Также очищаем данные в plotArea
-            break;
-        case 6: // Сохранить графики
-        {
-            std::string filename;
-            std::cout << "Введите имя файла для сохранения: ";
-            std::cin >> filename;
-            plotArea.saveToFile(filename);
-            std::cout << "Графики сохранены в файл " << filename << ".\n";
-            break;
-        }
-        case 7: // Загрузить графики
-        {
-            std::string filename;
-            std::cout << "Введите имя файла для загрузки: ";
-            std::cin >> filename;
-            plotArea.loadFromFile(filename);
-            std::cout << "Графики загружены из файла " << filename << ".\n";
-            break;
+        // Перерисовываем только изменившееся; если ничего не изменилось,
+        // кадр пропускается и поток спит
+        if (graphPlotter.plot(window)) {
+            graphPlotter.display(window);
         }
-        case 8: // Выход
-            window.close();
-            break;
-            // Обработка других случаев...
-        default:
-            std::cout << "Неверный выбор. Пожалуйста, попробуйте снова.\n";
-            break;
+        else {
+            sf::sleep(sf::milliseconds(15));
         }
-
     }
 
     return 0;